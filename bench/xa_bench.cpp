@@ -0,0 +1,232 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Timings of the parts of XMLAtlas that do not need Qt
+ * Built with -DXA_BUILD_BENCH=ON, run as XMLAtlasBench [section...], all sections without arguments.
+ */
+
+#include "xa_byte_scan.h"
+#include "xa_span_index.h"
+#include "xa_token_stream.h"
+#include "xa_xml_node_table.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // read by no one, keeps the optimizer from dropping the measured loops
+    volatile int64_t g_sink = 0;
+
+    /**
+     * Seconds taken by the fastest of runs calls of work
+     */
+    template <typename Work>
+    double fastest(int runs, Work work)
+    {
+        double best = 0;
+        for (int run = 0; run < runs; ++run)
+        {
+            auto start = Clock::now();
+            work();
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (run == 0 || seconds < best)
+                best = seconds;
+        }
+        return best;
+    }
+
+    /**
+     * XML of about size bytes with the markup the structural scan meets in real files:
+     * attributes, text, comments, CDATA sections and processing instructions
+     */
+    std::string generateXml(size_t size)
+    {
+        std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<catalog>\n";
+        for (int item = 0; xml.size() < size; ++item)
+        {
+            xml += "  <item id=\"" + std::to_string(item) + "\" kind=\"part\" state='active'>\n";
+            xml += "    <!-- revision " + std::to_string(item % 97) + " -->\n";
+            xml += "    <name>Part number " + std::to_string(item) + "</name>\n";
+            xml += "    <note><![CDATA[a < b && c > d]]></note>\n";
+            xml += "    <?render mode=\"plain\"?>\n";
+            xml += "    <size width=\"12.5\" height=\"4\"/>\n";
+            xml += "  </item>\n";
+        }
+        xml += "</catalog>\n";
+        return xml;
+    }
+
+    /**
+     * Lookups among the children of an element with count siblings, per call they have to take the same time
+     */
+    void benchNodeTable()
+    {
+        for (int count : { 1000, 100000, 1000000 })
+        {
+            XAXMLNodeTable table;
+            auto element = table.createChildren(XAXMLNodeTable::RootId, 1);
+            auto first = table.createChildren(element, count);
+            for (int row = 0; row < count; ++row)
+            {
+                table.setOffset(first + row, int64_t(row) * 32, 0);
+            }
+
+            auto parent = fastest(5, [&]() {
+                int64_t sum = 0;
+                for (auto id = first; id < first + count; ++id)
+                    sum += table.parent(id);
+                g_sink = sum;
+            });
+            auto row = fastest(5, [&]() {
+                int64_t sum = 0;
+                for (auto id = first; id < first + count; ++id)
+                    sum += table.row(id);
+                g_sink = sum;
+            });
+            auto child = fastest(5, [&]() {
+                int64_t sum = 0;
+                for (int r = 0; r < count; ++r)
+                    sum += table.child(element, r);
+                g_sink = sum;
+            });
+
+            std::printf("node table  %7d siblings  parent %5.2f ns  row %5.2f ns  child %5.2f ns  table %zu KB\n",
+                count, parent * 1e9 / count, row * 1e9 / count, child * 1e9 / count,
+                table.memoryUsage() / 1024);
+        }
+    }
+
+    /**
+     * Structural scan of XASpanIndex alone and while collecting the tokens for the highlighter
+     */
+    void benchTokenScan()
+    {
+        auto xml = generateXml(size_t(32) << 20);
+        double megabytes = double(xml.size()) / (1 << 20);
+
+        size_t memory = 0;
+        auto index = fastest(3, [&]() {
+            XASpanIndex spans(xml.data(), xml.size());
+            memory = spans.memoryUsage();
+        });
+        size_t count = 0;
+        auto tokens = fastest(3, [&]() {
+            XATokenStream stream;
+            XASpanIndex spans(xml.data(), xml.size(), &stream);
+            count = stream.size();
+        });
+
+        std::printf("token scan  %5.1f MB  spans %7.1f MB/s  spans+tokens %7.1f MB/s  %zu tokens  index %zu KB\n",
+            megabytes, megabytes / index, megabytes / tokens, count, memory / 1024);
+    }
+
+    /**
+     * XAByteScan with the kernel picked for this CPU and with the scalar one, on the searches of the editor and writer:
+     * markup in a document, line breaks in its UTF-8 and UTF-16 text and the whitespace skipped while indenting
+     */
+    void benchByteScan()
+    {
+        auto xml = generateXml(size_t(32) << 20);
+        std::u16string wide(xml.begin(), xml.end());
+        std::string indent;
+        while (indent.size() < xml.size())
+        {
+            indent.append(200, ' ');
+            indent.append("\t\n  \r<x/>");
+        }
+        const XAByteScan markup("<");
+        const XAByteScan line_breaks("\r\n");
+        const XAByteScan spaces(" \t\n\v\f\r");
+        double megabytes = double(xml.size()) / (1 << 20);
+
+        for (bool scalar : { false, true })
+        {
+            XAByteScan::forceScalar(scalar);
+            auto find = fastest(5, [&]() {
+                int64_t count = 0;
+                for (auto pos = markup.find(xml.data(), xml.size(), 0); pos < xml.size();
+                     pos = markup.find(xml.data(), xml.size(), pos + 1))
+                    ++count;
+                g_sink = count;
+            });
+            auto lines = fastest(5, [&]() {
+                int64_t count = 0;
+                for (auto pos = line_breaks.find(xml.data(), xml.size(), 0); pos < xml.size();
+                     pos = line_breaks.find(xml.data(), xml.size(), pos + 1))
+                    ++count;
+                g_sink = count;
+            });
+            auto wide_lines = fastest(5, [&]() {
+                int64_t count = 0;
+                for (auto pos = line_breaks.find(wide.data(), wide.size(), 0); pos < wide.size();
+                     pos = line_breaks.find(wide.data(), wide.size(), pos + 1))
+                    ++count;
+                g_sink = count;
+            });
+            auto skip = fastest(5, [&]() {
+                int64_t count = 0;
+                for (auto pos = spaces.skip(indent.data(), indent.size(), 0); pos < indent.size();
+                     pos = spaces.skip(indent.data(), indent.size(), pos + 1))
+                    ++count;
+                g_sink = count;
+            });
+
+            std::printf("byte scan  %-6s  find '<' %7.1f MB/s  lines %7.1f MB/s  UTF-16 lines %7.1f MB/s  skip %7.1f MB/s\n",
+                XAByteScan::kernel(), megabytes / find, megabytes / lines,
+                double(wide.size() * sizeof(char16_t)) / (1 << 20) / wide_lines,
+                double(indent.size()) / (1 << 20) / skip);
+        }
+        XAByteScan::forceScalar(false);
+    }
+
+    struct Section
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    const Section Sections[] = {
+        { "node-table", benchNodeTable },
+        { "token-scan", benchTokenScan },
+        { "byte-scan", benchByteScan },
+    };
+}
+
+
+int main(int argc, char* argv[])
+{
+    for (const auto& section : Sections)
+    {
+        bool wanted = argc < 2;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], section.name) == 0)
+                wanted = true;
+        }
+        if (wanted)
+            section.run();
+    }
+    return 0;
+}
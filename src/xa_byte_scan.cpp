@@ -0,0 +1,266 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xa_byte_scan.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define XA_SCAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define XA_TARGET_AVX2
+#else
+#define XA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+namespace
+{
+    /**
+     * Mask of a full chunk of ChunkSize bytes or characters
+     */
+    using ByteKernel = uint32_t(*)(const char* chunk, const char* bytes, int count);
+    using WideKernel = uint32_t(*)(const char16_t* chunk, const char* bytes, int count);
+
+    struct Kernels
+    {
+        ByteKernel  bytes;
+        WideKernel  wide;
+        const char* name;
+    };
+
+    template<typename Char>
+    uint32_t maskScalar(const Char* chunk, size_t length, const char* bytes, int count)
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            for (int b = 0; b < count; ++b)
+            {
+                if (chunk[i] == static_cast<Char>(static_cast<unsigned char>(bytes[b])))
+                {
+                    mask |= 1u << i;
+                    break;
+                }
+            }
+        }
+        return mask;
+    }
+
+    uint32_t bytesScalar(const char* chunk, const char* bytes, int count)
+    {
+        return maskScalar(chunk, XAByteScan::ChunkSize, bytes, count);
+    }
+
+    uint32_t wideScalar(const char16_t* chunk, const char* bytes, int count)
+    {
+        return maskScalar(chunk, XAByteScan::ChunkSize, bytes, count);
+    }
+
+#ifdef XA_SCAN_X86
+    uint32_t bytesSse2(const char* chunk, const char* bytes, int count)
+    {
+        auto low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk));
+        auto high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk + 16));
+        auto low_hits = _mm_setzero_si128();
+        auto high_hits = _mm_setzero_si128();
+        for (int b = 0; b < count; ++b)
+        {
+            auto byte = _mm_set1_epi8(bytes[b]);
+            low_hits = _mm_or_si128(low_hits, _mm_cmpeq_epi8(low, byte));
+            high_hits = _mm_or_si128(high_hits, _mm_cmpeq_epi8(high, byte));
+        }
+        return static_cast<uint32_t>(_mm_movemask_epi8(low_hits))
+            | (static_cast<uint32_t>(_mm_movemask_epi8(high_hits)) << 16);
+    }
+
+    uint32_t wideSse2(const char16_t* chunk, const char* bytes, int count)
+    {
+        // compare 16 bit lanes, then pack the results to one byte per character
+        uint32_t mask = 0;
+        for (int half = 0; half < 2; ++half)
+        {
+            auto first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk + 16 * half));
+            auto second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk + 16 * half + 8));
+            auto first_hits = _mm_setzero_si128();
+            auto second_hits = _mm_setzero_si128();
+            for (int b = 0; b < count; ++b)
+            {
+                auto character = _mm_set1_epi16(static_cast<unsigned char>(bytes[b]));
+                first_hits = _mm_or_si128(first_hits, _mm_cmpeq_epi16(first, character));
+                second_hits = _mm_or_si128(second_hits, _mm_cmpeq_epi16(second, character));
+            }
+            auto packed = _mm_packs_epi16(first_hits, second_hits);
+            mask |= static_cast<uint32_t>(_mm_movemask_epi8(packed)) << (16 * half);
+        }
+        return mask;
+    }
+
+    XA_TARGET_AVX2 uint32_t bytesAvx2(const char* chunk, const char* bytes, int count)
+    {
+        auto data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk));
+        auto hits = _mm256_setzero_si256();
+        for (int b = 0; b < count; ++b)
+        {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(data, _mm256_set1_epi8(bytes[b])));
+        }
+        return static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+    }
+
+    XA_TARGET_AVX2 uint32_t wideAvx2(const char16_t* chunk, const char* bytes, int count)
+    {
+        auto first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk));
+        auto second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk + 16));
+        auto first_hits = _mm256_setzero_si256();
+        auto second_hits = _mm256_setzero_si256();
+        for (int b = 0; b < count; ++b)
+        {
+            auto character = _mm256_set1_epi16(static_cast<unsigned char>(bytes[b]));
+            first_hits = _mm256_or_si256(first_hits, _mm256_cmpeq_epi16(first, character));
+            second_hits = _mm256_or_si256(second_hits, _mm256_cmpeq_epi16(second, character));
+        }
+        // packing works per 128 bit lane, the permute puts the characters back in order
+        auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(first_hits, second_hits), 0xD8);
+        return static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+    }
+
+    bool hasAvx2()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        // the OS has to save the AVX registers too
+        bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+        __cpuidex(info, 7, 0);
+        return os_avx && (info[1] & (1 << 5));
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    Kernels selectKernels()
+    {
+#ifdef XA_SCAN_X86
+        if (hasAvx2())
+            return { bytesAvx2, wideAvx2, "avx2" };
+        return { bytesSse2, wideSse2, "sse2" };
+#else
+        return { bytesScalar, wideScalar, "scalar" };
+#endif
+    }
+
+    std::atomic_bool s_force_scalar{ false };
+
+    const Kernels& kernels()
+    {
+        static const Kernels selected = selectKernels();
+        static const Kernels scalar = { bytesScalar, wideScalar, "scalar" };
+        return s_force_scalar ? scalar : selected;
+    }
+
+    /**
+     * Offset of the first character in the set at or behind pos, or of the first one not in it when inside is false
+     */
+    template<typename Char, typename Kernel>
+    size_t findIn(const Char* data, size_t size, size_t pos, const char* bytes, int count, Kernel kernel, bool inside = true)
+    {
+        while (pos < size && size - pos >= XAByteScan::ChunkSize)
+        {
+            auto mask = kernel(data + pos, bytes, count);
+            if (!inside)
+                mask = ~mask;
+            if (mask)
+            {
+                unsigned long bit = 0;
+#if defined(_MSC_VER)
+                _BitScanForward(&bit, mask);
+#else
+                bit = static_cast<unsigned long>(__builtin_ctz(mask));
+#endif
+                return pos + bit;
+            }
+            pos += XAByteScan::ChunkSize;
+        }
+
+        // the tail is shorter than a chunk
+        for (; pos < size; ++pos)
+        {
+            bool found = false;
+            for (int b = 0; b < count && !found; ++b)
+            {
+                found = data[pos] == static_cast<Char>(static_cast<unsigned char>(bytes[b]));
+            }
+            if (found == inside)
+                return pos;
+        }
+        return size;
+    }
+}
+
+
+XAByteScan::XAByteScan(const char* bytes, size_t count)
+    : m_bytes()
+    , m_count(static_cast<int>(std::min<size_t>(count, MaxBytes)))
+{
+    std::copy(bytes, bytes + m_count, m_bytes);
+}
+
+XAByteScan::XAByteScan(const char* bytes)
+    : XAByteScan(bytes, strlen(bytes))
+{
+}
+
+uint32_t XAByteScan::mask(const char* chunk, size_t length) const
+{
+    if (length >= ChunkSize)
+        return kernels().bytes(chunk, m_bytes, m_count);
+    return maskScalar(chunk, length, m_bytes, m_count);
+}
+
+size_t XAByteScan::find(const char* data, size_t size, size_t pos) const
+{
+    return findIn(data, size, pos, m_bytes, m_count, kernels().bytes);
+}
+
+size_t XAByteScan::find(const char16_t* data, size_t size, size_t pos) const
+{
+    return findIn(data, size, pos, m_bytes, m_count, kernels().wide);
+}
+
+size_t XAByteScan::skip(const char* data, size_t size, size_t pos) const
+{
+    return findIn(data, size, pos, m_bytes, m_count, kernels().bytes, false);
+}
+
+const char* XAByteScan::kernel()
+{
+    return kernels().name;
+}
+
+void XAByteScan::forceScalar(bool scalar)
+{
+    s_force_scalar = scalar;
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * Finds any of a small set of ASCII characters in text, a chunk at a time.
+ * A chunk is turned into a bit mask with bit i set where character i is in the set.
+ * On x86-64 the masks come from SSE2, or from AVX2 when the CPU has it, chosen once at run time.
+ * Other platforms compare character by character.
+ */
+class XAByteScan
+{
+public:
+    enum
+    {
+        ChunkSize = 32,
+        MaxBytes = 8
+    };
+
+    /**
+     * Looks for the first count bytes at bytes, at most MaxBytes
+     */
+    XAByteScan(const char* bytes, size_t count);
+
+    /**
+     * Looks for the bytes of a zero terminated string
+     */
+    explicit XAByteScan(const char* bytes);
+
+    /**
+     * Bit i is set where chunk[i] is in the set, for the first length bytes, length is at most ChunkSize
+     */
+    uint32_t mask(const char* chunk, size_t length) const;
+
+    /**
+     * Offset of the first byte of the set at or behind pos, size if there is none
+     */
+    size_t find(const char* data, size_t size, size_t pos) const;
+
+    /**
+     * Same for UTF-16 text, only ASCII characters can be looked for
+     */
+    size_t find(const char16_t* data, size_t size, size_t pos) const;
+
+    /**
+     * Offset of the first byte not in the set at or behind pos, size if there is none
+     */
+    size_t skip(const char* data, size_t size, size_t pos) const;
+
+    /**
+     * The kernel in use: "avx2", "sse2" or "scalar"
+     */
+    static const char* kernel();
+
+    /**
+     * Whether the scalar kernel is used, for comparing it against the vector ones
+     */
+    static void forceScalar(bool scalar);
+
+private:
+    char   m_bytes[MaxBytes];
+    int    m_count;
+};
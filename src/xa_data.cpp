@@ -16,135 +16,241 @@
  */
 
 #include "xa_data.h"
+#include "xa_document.h"
+#include "xa_xml_tree_builder.h"
 #include "xa_xml_tree_model.h"
-#include "xa_xml_tree_item.h"
 #include "xa_xml_writer.h"
+#include <algorithm>
 #include <sstream>
 #include <vector>
 #include <QDebug>
+#include <QStringList>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+
 
 namespace
 {
+    // elements larger than this are reparsed as a whole document
+    const int MaxFragmentLength = 4 * 1024 * 1024;
 
-    void appendAttributes(XAXMLTreeItem* item, const pugi::xml_node& node)
-    {
-        const auto& attributes = node.attributes();
-        for (const auto& attr : attributes)
-        {
-            item->appendChild(new XAXMLTreeItem{ attr.name(),
-                node,
-                XAXMLTreeItemType::ATTRIBUTE,
-                item });
-        }
-    }
+    // insertions up to this length, like typing, are read character by character without a selection
+    const int MaxDirectInsertLength = 64;
 
-    class XmlTreeBuilder : public pugi::xml_tree_walker
+    /**
+     * Reads one element from the editor, starting at its '<'
+     * Text is pulled in line by line until the matching end tag is found.
+     */
+    class ElementReader
     {
     public:
-        XmlTreeBuilder(XAXMLTreeModel* model, const pugi::xml_parse_result& parse_result)
-            : m_model(model)
-            , m_parse_result(parse_result)
-            , m_tree_root(nullptr)
-            , m_current_parent(nullptr)
-            , m_last_node(nullptr)
-            , m_last_depth(-1)
+        ElementReader(QTextDocument* document, int position)
+            : m_block(document->findBlock(position))
+            , m_text()
+            , m_content_start(0)
+            , m_content_end(0)
+            , m_end(0)
         {
-            m_tree_root = m_model->rootItem();
-            m_current_parent = m_tree_root;
-            m_last_node = m_current_parent;
+            if (m_block.isValid())
+            {
+                m_text = m_block.text().mid(position - m_block.position());
+            }
         }
 
-        // Callback that is called when traversal begins
-        bool begin(pugi::xml_node& node) override
+        /**
+         * Returns false if the tags do not pair up
+         */
+        bool read()
         {
-            return true;
-        }
+            QStringList open_tags;
+            int pos = 0;
 
-        // Callback that is called for each node traversed
-        bool for_each(pugi::xml_node& node) override
-        {                
+            if (!startsWith(0, "<"))
+                return false;
 
-            switch (node.type())
+            while (true)
             {
-            case pugi::node_element: {
-                auto current_depth = depth();
-                auto name = node.name();
-                if (m_last_depth < current_depth) {
-                    // node is the first child of a parent node
-                    // m_last_node is the parent for this node
-                    m_current_parent = m_last_node;
-                    auto new_node = new XAXMLTreeItem(node.name(), 
-                        node, 
-                        XAXMLTreeItemType::ELEMENT, 
-                        m_current_parent);
-                    appendAttributes(new_node, node);
-                    m_current_parent->appendChild(new_node);
-                    m_last_node = new_node;
+                int lt = indexOf("<", pos);
+                if (lt < 0)
+                    return false;
+
+                const char* skip_end = nullptr;
+                if (startsWith(lt, "<!--"))
+                    skip_end = "-->";
+                else if (startsWith(lt, "<![CDATA["))
+                    skip_end = "]]>";
+                else if (startsWith(lt, "<?"))
+                    skip_end = "?>";
+                else if (startsWith(lt, "<!"))
+                    return false;
+
+                if (skip_end)
+                {
+                    int end = indexOf(skip_end, lt + 2);
+                    if (end < 0)
+                        return false;
+                    pos = end + static_cast<int>(qstrlen(skip_end));
+                    continue;
                 }
-                else if (m_last_depth == current_depth) {
-                    // node is a sibling to the previous node
-                    auto new_node = new XAXMLTreeItem(node.name(), 
-                        node, 
-                        XAXMLTreeItemType::ELEMENT, 
-                        m_current_parent);
-                    appendAttributes(new_node, node);
-                    m_current_parent->appendChild(new_node);
-                    m_last_node = new_node;
+
+                bool closing = startsWith(lt, "</");
+                int name_start = lt + (closing ? 2 : 1);
+                int gt = findTagEnd(name_start);
+                if (gt < 0)
+                    return false;
+                QString name = tagName(name_start, gt);
+
+                if (closing)
+                {
+                    if (open_tags.isEmpty() || open_tags.last() != name)
+                        return false;
+                    open_tags.removeLast();
+                    if (open_tags.isEmpty())
+                    {
+                        m_content_end = lt;
+                        m_end = gt + 1;
+                        return true;
+                    }
                 }
-                else {
-                    // node is child on another branch
-                    auto last_depth = m_last_depth;
-                    while (current_depth < last_depth) {
-                        m_current_parent = m_current_parent->parentItem();
-                        --last_depth;
+                else
+                {
+                    bool empty = m_text.at(gt - 1) == QLatin1Char('/');
+                    if (lt == 0)
+                    {
+                        m_content_start = gt + 1;
+                        if (empty)
+                        {
+                            m_content_end = gt + 1;
+                            m_end = gt + 1;
+                            return true;
+                        }
                     }
-                    auto new_node = new XAXMLTreeItem(node.name(), 
-                        node, 
-                        XAXMLTreeItemType::ELEMENT, 
-                        m_current_parent);
-                    appendAttributes(new_node, node);
-                    m_current_parent->appendChild(new_node);
-                    m_last_node = new_node;
-
+                    if (!empty)
+                        open_tags.append(name);
                 }
-                m_last_depth = current_depth;
-                break;
+                pos = gt + 1;
             }
+        }
+
+        QString fragment() const { return m_text.left(m_end); }
+        int contentStart() const { return m_content_start; }
+        int contentEnd() const { return m_content_end; }
+
+    private:
+        bool more()
+        {
+            if (m_text.size() > MaxFragmentLength)
+                return false;
+
+            m_block = m_block.next();
+            if (!m_block.isValid())
+                return false;
+
+            m_text += QLatin1Char('\n');
+            m_text += m_block.text();
+            return true;
+        }
+
+        bool ensure(int pos)
+        {
+            while (pos >= m_text.size())
+            {
+                if (!more())
+                    return false;
             }
+            return true;
+        }
 
+        bool startsWith(int pos, const char* str)
+        {
+            for (int i = 0; str[i]; ++i)
+            {
+                if (!ensure(pos + i) || m_text.at(pos + i) != QLatin1Char(str[i]))
+                    return false;
+            }
             return true;
         }
 
-        // Callback that is called when traversal ends
-        bool end(pugi::xml_node& node) override
+        int indexOf(const char* str, int from)
         {
-            //qDebug() << node.offset_debug() << " : " << m_parse_result.offset << "  " << m_parse_result.description();
+            while (true)
+            {
+                int idx = m_text.indexOf(QLatin1String(str), from);
+                if (idx >= 0)
+                    return idx;
+                // the match may straddle the line break that is appended next
+                from = qMax(from, m_text.size() - static_cast<int>(qstrlen(str)));
+                if (!more())
+                    return -1;
+            }
+        }
 
-            if (m_parse_result.status != pugi::status_ok)
+        int findTagEnd(int from)
+        {
+            QChar quote;
+            for (int i = from; ensure(i); ++i)
             {
-                m_current_parent = m_last_node;
-                auto new_node = new XAXMLTreeItem(m_parse_result.description(),
-                    node,
-                    XAXMLTreeItemType::ERROR,
-                    m_current_parent);
-                m_current_parent->appendChild(new_node);
-                m_last_node = new_node;
+                QChar ch = m_text.at(i);
+                if (!quote.isNull())
+                {
+                    if (ch == quote)
+                        quote = QChar();
+                }
+                else if (ch == QLatin1Char('"') || ch == QLatin1Char('\''))
+                {
+                    quote = ch;
+                }
+                else if (ch == QLatin1Char('>'))
+                {
+                    return i;
+                }
             }
+            return -1;
+        }
 
-            return true;
+        QString tagName(int from, int to) const
+        {
+            int end = from;
+            while (end < to && !m_text.at(end).isSpace() && m_text.at(end) != QLatin1Char('/'))
+            {
+                ++end;
+            }
+            return m_text.mid(from, end - from);
         }
+
     private:
-        XAXMLTreeModel* m_model;
-        pugi::xml_parse_result m_parse_result;
-        XAXMLTreeItem* m_tree_root;
-        XAXMLTreeItem* m_current_parent;
-        XAXMLTreeItem* m_last_node;
-        int m_last_depth;
+        QTextBlock m_block;
+        QString    m_text;
+        int        m_content_start;
+        int        m_content_end;
+        int        m_end;
     };
+
+    /**
+     * Start of the first element behind the subtree of index, -1 at the document end
+     */
+    int64_t followingElementOffset(const XAXMLTreeModel* model, QModelIndex index)
+    {
+        for (; index.isValid(); index = index.parent())
+        {
+            auto parent = index.parent();
+            int rows = model->rowCount(parent);
+            for (int row = index.row() + 1; row < rows; ++row)
+            {
+                auto sibling = model->index(row, 0, parent);
+                auto type = model->getItemType(sibling);
+                if (type == XAXMLTreeItemType::ELEMENT || type == XAXMLTreeItemType::RANGE)
+                    return model->getOffset(sibling) - 1;
+            }
+        }
+        return -1;
+    }
 }
 
 
 XAData::XAData(XATheme* theme)
+    : m_document(std::make_unique<XADocument>())
 {
     m_xml_tree_model = new XAXMLTreeModel(theme, this);
 }
@@ -159,11 +265,86 @@ XAXMLTreeModel* XAData::getXMLTreeModel() const
     return m_xml_tree_model;
 }
 
-pugi::xml_parse_result XAData::setContent(const QString& content)
+void XAData::setDocument(std::unique_ptr<XADocument> document, std::unique_ptr<XAXMLNodeTable> table)
+{
+    // the old items point into the old document, keep it until the model dropped them
+    auto old_document = std::move(m_document);
+    m_document = std::move(document);
+    m_xml_tree_model->setNodeTable(std::move(table), m_document->getOffsetMap(), m_document->getSpanIndex());
+    m_content = m_document->getPieceTable();
+}
+
+void XAData::clear()
+{
+    // the old items point into the old document, keep it until the model dropped them
+    auto old_document = std::move(m_document);
+    m_document = std::make_unique<XADocument>();
+    m_xml_tree_model->clear();
+    m_content = XAPieceTable();
+    m_filename.clear();
+}
+
+QString XAData::getContent() const
+{
+    return m_document->getText();
+}
+
+const XAPieceTable& XAData::getContentBuffer() const
+{
+    return m_content;
+}
+
+void XAData::updateContent(QTextDocument* text, int position, int chars_removed, int chars_added)
+{
+    // the counts can include the paragraph separator QTextDocument keeps behind the last line
+    auto length = text->characterCount() - 1;
+    chars_added = std::max(0, std::min(chars_added, length - position));
+
+    QString inserted;
+    if (chars_added <= MaxDirectInsertLength)
+    {
+        inserted.reserve(chars_added);
+        for (int i = 0; i < chars_added; ++i)
+            inserted.append(text->characterAt(position + i));
+    }
+    else
+    {
+        QTextCursor cursor(text);
+        cursor.setPosition(position);
+        cursor.setPosition(position + chars_added, QTextCursor::KeepAnchor);
+        inserted = cursor.selectedText();
+    }
+
+    // line breaks are paragraph separators in the editor, the buffer holds them as written
+    inserted.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+    inserted.replace(QChar::LineSeparator, QLatin1Char('\n'));
+
+    m_content.replace(position, chars_removed, inserted);
+}
+
+bool XAData::hasContent() const
 {
-    m_content = content;
-    auto parse_result = m_doc.load_string(content.toStdString().c_str());
-    return parse_result;
+    return m_document->hasText();
+}
+
+const char* XAData::getSource() const
+{
+    return m_document->getSource();
+}
+
+size_t XAData::getSourceSize() const
+{
+    return m_document->size();
+}
+
+std::shared_ptr<const XARowIndex> XAData::getRowIndex() const
+{
+    return m_document->getRowIndex();
+}
+
+std::shared_ptr<const XATokenStream> XAData::getTokenStream() const
+{
+    return m_document->getTokenStream();
 }
 
 void XAData::setFilename(const QString& filename)
@@ -185,23 +366,66 @@ QString XAData::indentDocument(int indent_size, int max_attr_per_line, bool use_
     xw.setAttributesPerLine(max_attr_per_line);
     xw.setUseSpaces(use_spaces);
 
-    xw.write(m_doc, sbuff);
+    xw.write(m_document->getDocument(), sbuff);
 
     return QString::fromStdString(sbuff.str());
 }
 
 pugi::xml_document& XAData::getDocument()
 {
-    return m_doc;
+    return m_document->getDocument();
 }
 
-void XAData::buildTreeModelFromContent(const pugi::xml_parse_result& parse_result)
+bool XAData::applyEdit(QTextDocument* text, int position, int chars_removed, int chars_added)
 {
-    m_xml_tree_model->clear();
+    // an erroneous document has to be parsed as a whole to get rid of the error
+    if (!m_document->getParseResult())
+        return false;
+
+    auto model = m_xml_tree_model;
+
+    // innermost element around the change, from the DOM and the span index below collapsed items
+    // only the items on the way to it are created, its subtree stays as it is
+    auto index = model->indexAtLocation(model->locate(position));
+
+    // walk up until an element encloses the change, the document element is left to a full parse
+    for (; index.isValid() && index.parent().isValid(); index = index.parent())
+    {
+        // a range only groups the rows, its offset is the one of its first element
+        if (model->getItemType(index) == XAXMLTreeItemType::RANGE)
+            continue;
+
+        auto start = model->getOffset(index) - 1;
+        if (start < 0 || start >= position)
+            continue;
 
-    XmlTreeBuilder tb(m_xml_tree_model, parse_result);
+        // the removed text must not reach into the next element
+        auto following = followingElementOffset(model, index);
+        if (following >= 0 && position + chars_removed > following)
+            continue;
+
+        ElementReader reader(text, static_cast<int>(start));
+        if (!reader.read())
+            continue;
+        if (position + chars_added > start + reader.contentEnd())
+            continue;
+
+        // the patch stays with the items below the element, they are built from it on expand
+        auto patch = std::make_shared<XAXMLPatch>(reader.fragment().toStdString(), start);
+        if (!patch->result)
+            return false;
+
+        auto node = model->getNode(index);
+        auto parent_node = node.parent();
+
+        model->beginReplaceNode(index);
+        auto target = parent_node.insert_copy_after(patch->document.document_element(), node);
+        parent_node.remove_child(node);
+
+        model->recordEdit(position, chars_added - chars_removed);
+        model->endReplaceNode(index, target, std::move(patch));
+        return true;
+    }
 
-    m_xml_tree_model->beginFillModel();
-    m_doc.traverse(tb);
-    m_xml_tree_model->endFillModel();
+    return false;
 }
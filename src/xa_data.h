@@ -18,9 +18,16 @@
 #pragma once
 
 #include "pugixml.hpp"
+#include "xa_piece_table.h"
 #include <QObject>
+#include <memory>
 
 
+class QTextDocument;
+class XADocument;
+class XARowIndex;
+class XATokenStream;
+class XAXMLNodeTable;
 class XAXMLTreeModel;
 class XATheme;
 
@@ -37,7 +44,48 @@ public:
 
     XAXMLTreeModel* getXMLTreeModel() const;
 
-    pugi::xml_parse_result setContent(const QString& content);
+    /**
+     * Takes over a document loaded in the background together with its tree items
+     */
+    void setDocument(std::unique_ptr<XADocument> document, std::unique_ptr<XAXMLNodeTable> table);
+
+    /**
+     * Drops the document, its tree, the edit buffer and the file name, as for a new file
+     */
+    void clear();
+
+    /**
+     * Returns the text of the current document
+     */
+    QString getContent() const;
+
+    /**
+     * The editor text with all edits so far, a copy is a snapshot to parse from
+     */
+    const XAPieceTable& getContentBuffer() const;
+
+    /**
+     * Applies an editor change to the content buffer, has to be called for every change
+     * made after the document text was put into the editor
+     */
+    void updateContent(QTextDocument* text, int position, int chars_removed, int chars_added);
+
+    /**
+     * Whether the document has editor text, otherwise it is shown from getSource
+     */
+    bool hasContent() const;
+    const char* getSource() const;
+    size_t getSourceSize() const;
+
+    /**
+     * Rows of the source for the large file view, built with the document
+     */
+    std::shared_ptr<const XARowIndex> getRowIndex() const;
+
+    /**
+     * Markup tokens of the last load or full parse, nullptr unless they were collected
+     */
+    std::shared_ptr<const XATokenStream> getTokenStream() const;
 
     void setFilename(const QString& filename);
     QString getFilename() const;
@@ -46,11 +94,15 @@ public:
 
     pugi::xml_document& getDocument();
 
-    void buildTreeModelFromContent(const pugi::xml_parse_result& parse_result);
+    /**
+     * Reparses only the smallest element enclosing an editor change and patches its tree rows
+     * Returns false if the change can not be applied locally and needs a full reparse.
+     */
+    bool applyEdit(QTextDocument* text, int position, int chars_removed, int chars_added);
 
 private:
     XAXMLTreeModel*     m_xml_tree_model;
-    QString             m_content;
-    pugi::xml_document  m_doc;
+    std::unique_ptr<XADocument> m_document;
+    XAPieceTable        m_content;
     QString             m_filename;
 };
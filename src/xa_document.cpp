@@ -0,0 +1,327 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xa_document.h"
+#include <QFile>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#if defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#endif
+
+
+namespace
+{
+    bool hasLineLongerThan(const char* data, size_t size, size_t limit, const XAScanProgress& progress)
+    {
+        size_t pos = 0;
+        size_t next_report = XAScanProgressStep;
+        while (size - pos > limit)
+        {
+            if (progress && pos >= next_report)
+            {
+                // a canceled check is as good as any answer, the document is dropped
+                if (!progress(pos))
+                    return false;
+                next_report = pos + XAScanProgressStep;
+            }
+
+            auto hit = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+            if (!hit)
+                return true;
+            auto end = static_cast<size_t>(hit - data);
+            if (end - pos > limit)
+                return true;
+            pos = end + 1;
+        }
+        return false;
+    }
+}
+
+
+XADocument::XADocument()
+    : m_source_owner()
+    , m_source(nullptr)
+    , m_mapped(false)
+    , m_has_text(true)
+    , m_size(0)
+    , m_offsets(std::make_shared<XAOffsetMap>())
+    , m_spans(std::make_shared<XASpanIndex>())
+    , m_rows(std::make_shared<XARowIndex>())
+    , m_tokens()
+    , m_collect_tokens(false)
+    , m_progress()
+    , m_canceled(false)
+    , m_doc()
+    , m_parse_result()
+    , m_parse_count(0)
+{
+}
+
+XADocument::~XADocument()
+{
+    reset();
+}
+
+pugi::xml_parse_result XADocument::loadFile(const QString& filename, size_t text_limit, size_t line_limit)
+{
+    if (!mapFile(filename, text_limit, line_limit))
+    {
+        m_parse_result = pugi::xml_parse_result();
+        m_parse_result.status = pugi::status_file_not_found;
+        return m_parse_result;
+    }
+
+    return parse();
+}
+
+bool XADocument::mapFile(const QString& filename, size_t text_limit, size_t line_limit)
+{
+    reset();
+
+    auto file = std::make_shared<QFile>(filename);
+    if (!file->open(QFile::ReadOnly))
+        return false;
+
+    // a single read-only mapping, it shares the page cache instead of taking memory of its own
+    auto size = file->size();
+    if (size > 0)
+        m_source = reinterpret_cast<const char*>(file->map(0, size));
+    if (m_source)
+    {
+        m_source_owner = file;
+        m_mapped = true;
+    }
+    else
+    {
+        // QByteArray sizes are int
+        if (size > INT_MAX)
+        {
+            reset();
+            return false;
+        }
+        auto copy = std::make_shared<QByteArray>(file->readAll());
+        m_source = copy->constData();
+        m_source_owner = copy;
+        size = copy->size();
+    }
+    m_size = static_cast<size_t>(size);
+
+    // too large for the editor, or a single line of a minified file would stall its layout,
+    // the file is shown from the source and offsets stay byte offsets
+    // the editor text is a QString, whose size is an int
+    text_limit = std::min(text_limit, static_cast<size_t>(INT_MAX));
+    m_has_text = m_size <= text_limit && !hasLineLongerThan(m_source, m_size, line_limit, stageProgress(0, 10));
+    if (m_has_text && !m_canceled)
+        m_offsets = std::make_shared<XAOffsetMap>(m_source, m_size, m_source_owner, stageProgress(10, 40));
+    // the large file view gets its rows from here, a pass over many GB would stall the GUI thread
+    if (!m_has_text && !m_canceled)
+        m_rows = std::make_shared<XARowIndex>(m_source, m_size, stageProgress(10, 40));
+    if (m_canceled)
+        return false;
+
+    return scan(stageProgress(40, 100));
+}
+
+pugi::xml_parse_result XADocument::parse()
+{
+    return parseSource();
+}
+
+pugi::xml_parse_result XADocument::loadText(const XAPieceTable& text)
+{
+    reset();
+
+    if (text.isSource())
+    {
+        // nothing was edited since the last parse, the source and its offset map are shared as they are
+        m_source = text.source();
+        m_source_owner = text.owner();
+        m_offsets = text.offsetMap();
+    }
+    else
+    {
+        // QByteArray sizes are int
+        if (text.size() > static_cast<size_t>(INT_MAX))
+        {
+            m_parse_result = pugi::xml_parse_result();
+            return m_parse_result;
+        }
+
+        // the pieces are read once into the new source
+        auto source = std::make_shared<QByteArray>(static_cast<int>(text.size()), Qt::Uninitialized);
+        text.read(source->data());
+        m_source = source->constData();
+        m_source_owner = source;
+        m_offsets = std::make_shared<XAOffsetMap>(m_source, text.size(), m_source_owner);
+    }
+    m_size = text.size();
+
+    if (!scan(stageProgress(0, 100)))
+    {
+        m_parse_result = pugi::xml_parse_result();
+        return m_parse_result;
+    }
+
+    return parseSource();
+}
+
+QString XADocument::getText() const
+{
+    if (!m_has_text || m_size > static_cast<size_t>(INT_MAX))
+        return QString();
+    auto text = QString::fromUtf8(m_source, static_cast<int>(m_size));
+    releaseSource();
+    return text;
+}
+
+XAPieceTable XADocument::getPieceTable() const
+{
+    return XAPieceTable(m_source, m_size, m_source_owner, m_offsets);
+}
+
+bool XADocument::hasText() const
+{
+    return m_has_text;
+}
+
+const char* XADocument::getSource() const
+{
+    return m_source;
+}
+
+std::shared_ptr<const XAOffsetMap> XADocument::getOffsetMap() const
+{
+    return m_offsets;
+}
+
+std::shared_ptr<const XASpanIndex> XADocument::getSpanIndex() const
+{
+    return m_spans;
+}
+
+void XADocument::setProgress(std::function<bool(int percent)> progress)
+{
+    m_progress = std::move(progress);
+}
+
+void XADocument::setCollectTokens(bool collect)
+{
+    m_collect_tokens = collect;
+}
+
+std::shared_ptr<const XARowIndex> XADocument::getRowIndex() const
+{
+    return m_rows;
+}
+
+std::shared_ptr<const XATokenStream> XADocument::getTokenStream() const
+{
+    return m_tokens;
+}
+
+pugi::xml_document& XADocument::getDocument()
+{
+    return m_doc;
+}
+
+const pugi::xml_parse_result& XADocument::getParseResult() const
+{
+    return m_parse_result;
+}
+
+size_t XADocument::size() const
+{
+    return m_size;
+}
+
+bool XADocument::isMapped() const
+{
+    return m_mapped;
+}
+
+int XADocument::getParseCount() const
+{
+    return m_parse_count;
+}
+
+void XADocument::reset()
+{
+    m_doc.reset();
+    m_source_owner.reset();
+    m_source = nullptr;
+    m_mapped = false;
+    m_has_text = true;
+    m_offsets = std::make_shared<XAOffsetMap>();
+    m_spans = std::make_shared<XASpanIndex>();
+    m_rows = std::make_shared<XARowIndex>();
+    m_tokens.reset();
+    m_size = 0;
+    m_canceled = false;
+}
+
+bool XADocument::scan(const XAScanProgress& progress)
+{
+    // the tokens come from the same scan as the spans, highlighting reads the markup like the tree does
+    if (!m_collect_tokens || !m_has_text || m_size > XATokenStream::MaxTextSize)
+    {
+        m_spans = std::make_shared<XASpanIndex>(m_source, m_size, nullptr, progress);
+        return !m_canceled;
+    }
+
+    auto tokens = std::make_shared<XATokenStream>();
+    m_spans = std::make_shared<XASpanIndex>(m_source, m_size, tokens.get(), progress);
+    if (m_canceled)
+        return false;
+    tokens->translate(*m_offsets);
+    m_tokens = tokens;
+    return true;
+}
+
+XAScanProgress XADocument::stageProgress(int first, int last)
+{
+    if (!m_progress)
+        return XAScanProgress();
+
+    // the stage covers first to last percent of the scans
+    auto size = std::max<size_t>(m_size, 1);
+    return [this, first, last, size](size_t done) {
+        auto percent = first + static_cast<int>((last - first) * std::min(done, size) / size);
+        m_canceled = !m_progress(percent);
+        return !m_canceled;
+        };
+}
+
+pugi::xml_parse_result XADocument::parseSource()
+{
+    // the source stays as it is, the parser rewrites a copy it keeps itself
+    ++m_parse_count;
+    m_parse_result = m_doc.load_buffer(m_source, m_size, pugi::parse_default, pugi::encoding_utf8);
+    releaseSource();
+    return m_parse_result;
+}
+
+void XADocument::releaseSource() const
+{
+    // the copy was read in full, the mapped pages come back from the page cache where they are read again
+    if (!m_mapped || m_size == 0)
+        return;
+#if defined(Q_OS_UNIX)
+    madvise(const_cast<char*>(m_source), m_size, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,165 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "xa_offset_map.h"
+#include "xa_piece_table.h"
+#include "xa_row_index.h"
+#include "xa_span_index.h"
+#include "xa_token_stream.h"
+#include "pugixml.hpp"
+#include <QByteArray>
+#include <QString>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+
+/**
+ * Owns the UTF-8 source buffer of a document and the pugixml DOM parsed from it.
+ * The source is never written to, pugixml parses a copy it keeps with the DOM.
+ * A file is mapped read-only once, after the passes over the whole file its pages are left to the
+ * page cache, so the parse buffer is the only copy that stays in memory.
+ */
+class XADocument
+{
+public:
+    XADocument();
+    ~XADocument();
+
+    XADocument(const XADocument&) = delete;
+    XADocument& operator=(const XADocument&) = delete;
+
+    /**
+     * Maps the file read-only and parses it
+     * Falls back to reading the file if it can not be mapped
+     */
+    pugi::xml_parse_result loadFile(const QString& filename, size_t text_limit = SIZE_MAX, size_t line_limit = SIZE_MAX);
+
+    /**
+     * First stage of loadFile: maps the file and indexes offsets and spans
+     * A file larger than text_limit or with a line longer than line_limit gets no editor text,
+     * it is shown from getSource and offsets stay byte offsets.
+     * Returns false if the file can not be opened or the progress callback canceled.
+     */
+    bool mapFile(const QString& filename, size_t text_limit = SIZE_MAX, size_t line_limit = SIZE_MAX);
+
+    /**
+     * Second stage of loadFile: parses the source
+     */
+    pugi::xml_parse_result parse();
+
+    /**
+     * Parses editor content, which becomes the source of the document
+     */
+    pugi::xml_parse_result loadText(const XAPieceTable& text);
+
+    /**
+     * Decodes the document text as shown in the editor
+     */
+    QString getText() const;
+
+    /**
+     * The source as the only piece of an edit buffer, see XAData::updateContent
+     */
+    XAPieceTable getPieceTable() const;
+
+    /**
+     * Whether there is editor text, false for a file beyond the limits of mapFile
+     */
+    bool hasText() const;
+
+    /**
+     * The text the document was parsed from, size() bytes
+     * A read-only mapping of the file or a copy of the text, the parser does not write to it.
+     */
+    const char* getSource() const;
+
+    /**
+     * Translates byte offsets of the DOM to positions in the editor text
+     * Built over the source, the tree model shares it for its lazy fetches.
+     */
+    std::shared_ptr<const XAOffsetMap> getOffsetMap() const;
+
+    /**
+     * Element and attribute spans found by scanning the source before it was parsed
+     */
+    std::shared_ptr<const XASpanIndex> getSpanIndex() const;
+
+    /**
+     * Rows of the source for XALargeFileView, only built by mapFile when there is no editor text
+     */
+    std::shared_ptr<const XARowIndex> getRowIndex() const;
+
+    /**
+     * Receives how far the scans of mapFile and loadText are in percent, they come before the parse
+     * Returning false cancels the scan, mapFile then returns false and loadText does not parse.
+     */
+    void setProgress(std::function<bool(int percent)> progress);
+
+    /**
+     * Whether mapFile and loadText collect the markup tokens of the scan for highlighting, off by default
+     * Texts above XATokenStream::MaxTextSize are never tokenized.
+     */
+    void setCollectTokens(bool collect);
+
+    /**
+     * Markup tokens in editor positions, nullptr if they were not collected or there is no editor text
+     */
+    std::shared_ptr<const XATokenStream> getTokenStream() const;
+
+    pugi::xml_document& getDocument();
+    const pugi::xml_parse_result& getParseResult() const;
+
+    /**
+     * Size of the source buffer in bytes
+     */
+    size_t size() const;
+
+    bool isMapped() const;
+
+    /**
+     * Number of parses run on this document
+     * Lets debug builds check that a load parses exactly once.
+     */
+    int getParseCount() const;
+
+private:
+    void reset();
+    bool scan(const XAScanProgress& progress);
+    XAScanProgress stageProgress(int first, int last);
+    pugi::xml_parse_result parseSource();
+    void releaseSource() const;
+
+private:
+    std::shared_ptr<const void> m_source_owner;
+    const char*             m_source;
+    bool                    m_mapped;
+    bool                    m_has_text;
+    size_t                  m_size;
+    std::shared_ptr<const XAOffsetMap> m_offsets;
+    std::shared_ptr<const XASpanIndex> m_spans;
+    std::shared_ptr<const XARowIndex> m_rows;
+    std::shared_ptr<const XATokenStream> m_tokens;
+    bool                    m_collect_tokens;
+    std::function<bool(int percent)> m_progress;
+    bool                    m_canceled;
+    pugi::xml_document      m_doc;
+    pugi::xml_parse_result  m_parse_result;
+    int                     m_parse_count;
+};
@@ -0,0 +1,262 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xa_document_loader.h"
+#include "xa_document.h"
+#include "xa_xml_node_table.h"
+#include "xa_xml_tree_builder.h"
+#include <QThread>
+
+
+struct XADocumentLoader::Job
+{
+    QString                        filename;
+    XAPieceTable                   text;
+    size_t                         text_limit = SIZE_MAX;
+    size_t                         line_limit = SIZE_MAX;
+    bool                           collect_tokens = false;
+    int                            revision = 0;
+    int                            parse_count = 0;
+    std::atomic_bool               canceled{ false };
+    std::unique_ptr<XADocument>    document;
+    std::unique_ptr<XAXMLNodeTable> table;
+    QString                        error;
+};
+
+
+XADocumentLoader::XADocumentLoader(QObject* parent)
+    : QObject(parent)
+    , m_job()
+    , m_result()
+    , m_text_limit(SIZE_MAX)
+    , m_line_limit(SIZE_MAX)
+    , m_collect_tokens(false)
+    , m_threads()
+{
+}
+
+XADocumentLoader::~XADocumentLoader()
+{
+    if (m_job)
+    {
+        m_job->canceled = true;
+    }
+
+    // pugixml can not be interrupted, wait for the parser to return
+    for (auto thread : m_threads)
+    {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void XADocumentLoader::load(const QString& filename)
+{
+    auto job = std::make_shared<Job>();
+    job->filename = filename;
+    job->text_limit = m_text_limit;
+    job->line_limit = m_line_limit;
+    job->collect_tokens = m_collect_tokens;
+    start(job);
+
+    emit progress(0, tr("Reading"));
+}
+
+void XADocumentLoader::parseText(const XAPieceTable& text, int revision)
+{
+    auto job = std::make_shared<Job>();
+    job->text = text;
+    job->revision = revision;
+    job->collect_tokens = m_collect_tokens;
+    start(job);
+}
+
+void XADocumentLoader::start(const std::shared_ptr<Job>& job)
+{
+    // a new job supersedes the running one
+    if (m_job)
+    {
+        m_job->canceled = true;
+    }
+    m_result.reset();
+    m_job = job;
+
+    auto thread = QThread::create([this, job]() { run(job); });
+    connect(thread, &QThread::finished, this, [this, thread]() {
+        m_threads.removeOne(thread);
+        thread->deleteLater();
+        });
+    m_threads.append(thread);
+    thread->start();
+}
+
+void XADocumentLoader::cancel()
+{
+    if (!m_job)
+        return;
+
+    m_job->canceled = true;
+    m_job.reset();
+    emit canceled();
+}
+
+bool XADocumentLoader::isLoading() const
+{
+    return m_job != nullptr;
+}
+
+std::unique_ptr<XADocument> XADocumentLoader::takeDocument()
+{
+    if (!m_result)
+        return nullptr;
+    return std::move(m_result->document);
+}
+
+std::unique_ptr<XAXMLNodeTable> XADocumentLoader::takeNodeTable()
+{
+    if (!m_result)
+        return nullptr;
+    return std::move(m_result->table);
+}
+
+QString XADocumentLoader::getFilename() const
+{
+    if (!m_result)
+        return QString();
+    return m_result->filename;
+}
+
+int XADocumentLoader::getRevision() const
+{
+    if (!m_result)
+        return 0;
+    return m_result->revision;
+}
+
+int XADocumentLoader::getParseCount() const
+{
+    if (!m_result)
+        return 0;
+    return m_result->parse_count;
+}
+
+void XADocumentLoader::setTextLimit(size_t text_limit)
+{
+    m_text_limit = text_limit;
+}
+
+void XADocumentLoader::setLineLimit(size_t line_limit)
+{
+    m_line_limit = line_limit;
+}
+
+void XADocumentLoader::setCollectTokens(bool collect)
+{
+    m_collect_tokens = collect;
+}
+
+void XADocumentLoader::run(const std::shared_ptr<Job>& job)
+{
+    // runs on the worker thread, members are only touched through queued calls
+
+    auto document = std::make_unique<XADocument>();
+    document->setCollectTokens(job->collect_tokens);
+    pugi::xml_parse_result parse_result;
+
+    if (job->filename.isEmpty())
+    {
+        // a live parse shows no progress, a newer edit still stops its scan
+        document->setProgress([job](int) { return !job->canceled; });
+        parse_result = document->loadText(job->text);
+        job->text = XAPieceTable();
+    }
+    else
+    {
+        // the scans of mapFile take the first half of the bar, pugixml can not report and takes the rest
+        int reported = -1;
+        document->setProgress([this, job, &reported](int percent) {
+            auto scaled = percent / 2;
+            if (scaled != reported)
+            {
+                reported = scaled;
+                reportProgress(job, scaled, tr("Scanning"));
+            }
+            return !job->canceled;
+            });
+
+        if (!document->mapFile(job->filename, job->text_limit, job->line_limit))
+        {
+            if (job->canceled)
+                return;
+            job->error = tr("Cannot open file %1.").arg(job->filename);
+            finish(job);
+            return;
+        }
+
+        if (job->canceled)
+            return;
+        reportProgress(job, 50, tr("Parsing"));
+
+        parse_result = document->parse();
+    }
+
+    if (job->canceled)
+        return;
+    if (!job->filename.isEmpty())
+        reportProgress(job, 95, tr("Building tree"));
+
+    // only the top level is built here, the model creates the rest when it is expanded
+    auto table = std::make_unique<XAXMLNodeTable>();
+    XAXMLTreeBuilder tb(parse_result);
+    tb.build(document->getDocument(), *table, *document->getOffsetMap());
+
+    // the callback refers to this run and its job
+    document->setProgress(nullptr);
+    job->parse_count = document->getParseCount();
+    job->document = std::move(document);
+    job->table = std::move(table);
+    finish(job);
+}
+
+void XADocumentLoader::reportProgress(const std::shared_ptr<Job>& job, int percent, const QString& stage)
+{
+    QMetaObject::invokeMethod(this, [this, job, percent, stage]() {
+        if (job == m_job)
+        {
+            emit progress(percent, stage);
+        }
+        }, Qt::QueuedConnection);
+}
+
+void XADocumentLoader::finish(const std::shared_ptr<Job>& job)
+{
+    QMetaObject::invokeMethod(this, [this, job]() {
+        // superseded or canceled meanwhile
+        if (job != m_job)
+            return;
+
+        m_job.reset();
+        if (!job->error.isEmpty())
+        {
+            emit failed(job->error);
+            return;
+        }
+
+        m_result = job;
+        emit loaded();
+        }, Qt::QueuedConnection);
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+class QThread;
+class XADocument;
+class XAPieceTable;
+class XAXMLNodeTable;
+
+
+/**
+ * Loads documents on a worker thread: read -> parse -> tree build
+ * Only the latest load is reported, starting a new load cancels the running one.
+ * Editor text is handled the same way, tagged with the editor revision it was taken from.
+ */
+class XADocumentLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    XADocumentLoader(QObject* parent = nullptr);
+    ~XADocumentLoader();
+
+    /**
+     * Starts loading the file in the background
+     */
+    void load(const QString& filename);
+
+    /**
+     * Starts parsing a snapshot of the editor text in the background
+     */
+    void parseText(const XAPieceTable& text, int revision);
+
+    /**
+     * Cancels the running load, the worker stops at the next check point
+     */
+    void cancel();
+
+    bool isLoading() const;
+
+    /**
+     * Hands over the result after loaded() was emitted
+     */
+    std::unique_ptr<XADocument> takeDocument();
+    std::unique_ptr<XAXMLNodeTable> takeNodeTable();
+    QString getFilename() const;
+    int getRevision() const;
+
+    /**
+     * Number of parses the last load ran, see XADocument::getParseCount
+     */
+    int getParseCount() const;
+
+    /**
+     * Files loaded from now on that are larger than text_limit bytes get no editor text,
+     * see XADocument::mapFile
+     */
+    void setTextLimit(size_t text_limit);
+
+    /**
+     * Files loaded from now on with a line longer than line_limit bytes get no editor text either
+     */
+    void setLineLimit(size_t line_limit);
+
+    /**
+     * Whether loads and parses from now on collect markup tokens, see XADocument::setCollectTokens
+     */
+    void setCollectTokens(bool collect);
+
+signals:
+    void progress(int percent, const QString& stage);
+    void loaded();
+    void failed(const QString& message);
+    void canceled();
+
+private:
+    struct Job;
+    void start(const std::shared_ptr<Job>& job);
+    void run(const std::shared_ptr<Job>& job);
+    void reportProgress(const std::shared_ptr<Job>& job, int percent, const QString& stage);
+    void finish(const std::shared_ptr<Job>& job);
+
+private:
+    std::shared_ptr<Job> m_job;
+    std::shared_ptr<Job> m_result;
+    size_t               m_text_limit;
+    size_t               m_line_limit;
+    bool                 m_collect_tokens;
+    QList<QThread*>      m_threads;
+};
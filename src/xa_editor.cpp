@@ -18,16 +18,18 @@
 #include "xa_editor.h"
 #include <QPainter>
 #include <QTextBlock>
-#include <QRegularExpression>
 #include "xa_app.h"
 #include "xa_theme.h"
-#include "xa_xml_tree_item.h"
 #include "pugixml.hpp"
 
 
 XAEditor::XAEditor(XAApp* app, QWidget *parent) 
     : QPlainTextEdit(parent)
     , m_theme(app->getTheme())
+    , m_marked_selections()
+    , m_tag_selections()
+    , m_first_visible_block(-1)
+    , m_last_visible_block(-1)
 {
     lineNumberArea = new LineNumberArea(this);
 
@@ -60,9 +62,10 @@ void XAEditor::updateLineNumberAreaWidth(int /* newBlockCount */)
     setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
 }
 
-void XAEditor::markSelectedRange(const XAXMLTreeItem* item)
+void XAEditor::markSelectedRange(XAXMLTreeItemType type, int64_t item_offset, int64_t item_end)
 {
-    QList<QTextEdit::ExtraSelection> extraSelections;
+    QList<QTextEdit::ExtraSelection>& extraSelections = m_marked_selections;
+    extraSelections.clear();
 
     if (!isReadOnly()) {
         QTextEdit::ExtraSelection selection;
@@ -71,19 +74,18 @@ void XAEditor::markSelectedRange(const XAXMLTreeItem* item)
 
         selection.format.setBackground(lineColor);
 
-        // highlight selection
-        auto offset = findFirstElementPos(item);
-        auto last_offset = findEndElementPos(item);
-        auto length = last_offset - offset;
+        // highlight selection, the spans were found when the document was scanned
+        auto offset = findFirstElementPos(type, item_offset);
+        auto last_offset = qMax(offset, item_end);
 
         QTextCursor cursor = textCursor();
         cursor.setPosition(static_cast<int>(offset), QTextCursor::MoveAnchor);
-        cursor.setPosition(static_cast<int>(offset + length), QTextCursor::KeepAnchor);
+        cursor.setPosition(static_cast<int>(last_offset), QTextCursor::KeepAnchor);
         selection.cursor = cursor;
         extraSelections.append(selection);
     }
 
-    setExtraSelections(extraSelections);
+    updateExtraSelections();
     if (!extraSelections.isEmpty()) {
         QTextCursor cursor = extraSelections.first().cursor;
         cursor.setPosition(cursor.selectionStart(), QTextCursor::MoveAnchor);
@@ -92,135 +94,107 @@ void XAEditor::markSelectedRange(const XAXMLTreeItem* item)
     }
 }
 
-size_t XAEditor::findFirstElementPos(const XAXMLTreeItem* item)
+void XAEditor::markMatchingTags(int64_t item_offset, int64_t item_end)
 {
-    auto node = item->getNode();
-    auto offset = node.offset_debug();
+    m_tag_selections.clear();
 
-    switch (item->getItemType())
+    auto offset = item_offset - 1;
+    if (item_offset > 0 && item_end > offset && item_end < document()->characterCount())
     {
-    case XAXMLTreeItemType::ELEMENT:
-    {
-        return offset - 1;
-    } break;
+        // the spans come from the tree, only the tags themselves are looked at
+        auto start_tag_end = findStartTagEnd(offset, item_end);
+        auto end_tag_start = findEndTagStart(start_tag_end, item_end);
+        auto position = textCursor().position();
 
-    case XAXMLTreeItemType::ATTRIBUTE:
-    {
-        auto node = item->getNode();
-        auto attribute_name = QString::fromStdString(item->getValue());
-        QString pattern = QStringLiteral("\\b%1\\b").arg(QRegularExpression::escape(attribute_name));
-        QRegularExpression regex(pattern);
-
-        QTextDocument* document = this->document();
-        auto cursor = document->find(regex, offset);
-        if (cursor.isNull()) {
-            return 0; // Attribute not found
-        }
-        return cursor.selectionStart(); // Return the start of the match
+        if ((position >= offset && position <= start_tag_end) || (position >= end_tag_start && position <= item_end))
+        {
+            QTextEdit::ExtraSelection selection;
+            selection.format.setBackground(m_theme->getColorTheme() == "dark" ? QColor(0x3a3d41) : QColor(0xe2e6d6));
 
-    } break;
+            selection.cursor = textCursor();
+            selection.cursor.setPosition(static_cast<int>(offset), QTextCursor::MoveAnchor);
+            selection.cursor.setPosition(static_cast<int>(start_tag_end), QTextCursor::KeepAnchor);
+            m_tag_selections.append(selection);
 
-    default:
-        break;
+            // an empty element is its own end tag
+            if (start_tag_end < item_end)
+            {
+                selection.cursor.setPosition(static_cast<int>(end_tag_start), QTextCursor::MoveAnchor);
+                selection.cursor.setPosition(static_cast<int>(item_end), QTextCursor::KeepAnchor);
+                m_tag_selections.append(selection);
+            }
+        }
     }
 
-    return 0;
+    updateExtraSelections();
 }
 
-
-class CountElementVisitor : public pugi::xml_tree_walker
+void XAEditor::selectRange(XAXMLTreeItemType type, int64_t item_offset, int64_t item_end)
 {
-public:
-    CountElementVisitor(const std::string& elem_name) 
-        : m_element_name(elem_name)
-        , m_count(0) 
-    {}
+    auto offset = findFirstElementPos(type, item_offset);
+    if (item_end < offset)
+        return;
+
+    QTextCursor cursor = textCursor();
+    cursor.setPosition(static_cast<int>(offset), QTextCursor::MoveAnchor);
+    cursor.setPosition(static_cast<int>(item_end), QTextCursor::KeepAnchor);
+    setTextCursor(cursor);
+    ensureCursorVisible();
+}
 
-    virtual bool for_each(pugi::xml_node& node)
+int64_t XAEditor::findStartTagEnd(int64_t offset, int64_t end_offset) const
+{
+    // a '>' in an attribute value does not close the tag
+    QChar quote;
+    for (auto position = offset + 1; position < end_offset; ++position)
     {
-        if (node.type() == pugi::node_element)
+        auto ch = document()->characterAt(static_cast<int>(position));
+        if (!quote.isNull())
         {
-            if (node.name() == m_element_name)
-            {
-                m_count++;
-            }
+            if (ch == quote)
+                quote = QChar();
+        }
+        else if (ch == QLatin1Char('"') || ch == QLatin1Char('\''))
+        {
+            quote = ch;
+        }
+        else if (ch == QLatin1Char('>'))
+        {
+            return position + 1;
         }
-        return true;
     }
+    return end_offset;
+}
 
-    size_t getCount() const 
-    { 
-        return m_count; 
+int64_t XAEditor::findEndTagStart(int64_t offset, int64_t end_offset) const
+{
+    for (auto position = end_offset - 1; position >= offset; --position)
+    {
+        if (document()->characterAt(static_cast<int>(position)) == QLatin1Char('<'))
+            return position;
     }
+    return end_offset;
+}
 
-private:
-    std::string m_element_name;
-    int m_count;
-};
-
-
-size_t XAEditor::findEndElementPos(const XAXMLTreeItem* item)
+void XAEditor::updateExtraSelections()
 {
-    auto node = item->getNode();
-    auto offset = node.offset_debug();
+    setExtraSelections(m_marked_selections + m_tag_selections);
+}
 
-    switch (item->getItemType())
+int64_t XAEditor::findFirstElementPos(XAXMLTreeItemType type, int64_t offset)
+{
+    switch (type)
     {
     case XAXMLTreeItemType::ELEMENT:
+    case XAXMLTreeItemType::RANGE:
     {
-        auto end_offset = offset;
-        QTextDocument* document = this->document();
-
-        auto child_count = std::distance(node.begin(), node.end());
-        if (child_count == 0)
-        {
-            QString pattern = QStringLiteral("/>").arg(QRegularExpression::escape(node.name()));
-            QRegularExpression regex(pattern);
-            auto cursor = document->find(regex, end_offset);
-            if (cursor.isNull()) {
-                return 0; // End element not found
-            }
-            end_offset = cursor.selectionEnd(); // Return the end of the match
-        }
-        else
-        {
-            // Count nested child elements with the same name
-            CountElementVisitor visitor(node.name());
-            node.traverse(visitor);
-
-            QString pattern = QStringLiteral("</%1>").arg(QRegularExpression::escape(node.name()));
-            QRegularExpression regex(pattern);
-
-            for (int i = 0; i <= visitor.getCount(); i++)
-            {
-                auto cursor = document->find(regex, end_offset);
-                if (cursor.isNull()) {
-                    return 0; // End element not found
-                }
-                end_offset = cursor.selectionEnd(); // Return the end of the match
-            }
-        }
-        return end_offset;
+        // element offsets point at the name, the selection starts with the bracket
+        return qMax<int64_t>(0, offset - 1);
     } break;
 
     case XAXMLTreeItemType::ATTRIBUTE:
     {
-        auto attribute_name = QString::fromStdString(item->getValue());
-        QString pattern = QStringLiteral("\\b%1\\b\\s*=\\s*\"([^\"]*)\"").arg(QRegularExpression::escape(attribute_name));
-        QRegularExpression regex(pattern);
-
-        QTextDocument* document = this->document();
-        auto cursor = document->find(regex, offset);
-        if (cursor.isNull()) {
-            return 0; // Attribute not found
-        }
-
-        // Get the matched text
-        auto match = regex.match(document->toPlainText(), cursor.selectionStart());
-        if (match.hasMatch()) {
-            auto attribute_value = match.captured(1);
-            return cursor.selectionStart() + match.capturedLength(0); // End of the attribute value
-        }
+        return qMax<int64_t>(0, offset);
     } break;
 
     default:
@@ -239,6 +213,28 @@ void XAEditor::updateLineNumberArea(const QRect &rect, int dy)
 
     if (rect.contains(viewport()->rect()))
         updateLineNumberAreaWidth(0);
+
+    updateVisibleBlocks();
+}
+
+void XAEditor::updateVisibleBlocks()
+{
+    QTextBlock block = firstVisibleBlock();
+    int first = block.blockNumber();
+    int last = first;
+    qreal top = blockBoundingGeometry(block).translated(contentOffset()).top();
+
+    while (block.isValid() && top < viewport()->height()) {
+        last = block.blockNumber();
+        top += blockBoundingRect(block).height();
+        block = block.next();
+    }
+
+    if (first != m_first_visible_block || last != m_last_visible_block) {
+        m_first_visible_block = first;
+        m_last_visible_block = last;
+        emit visibleBlocksChanged(first, last);
+    }
 }
 
 void XAEditor::resizeEvent(QResizeEvent *e)
@@ -247,6 +243,7 @@ void XAEditor::resizeEvent(QResizeEvent *e)
 
     QRect cr = contentsRect();
     lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
+    updateVisibleBlocks();
 }
 
 void XAEditor::highlightCurrentLine()
@@ -19,6 +19,7 @@
 
 #include <QPlainTextEdit>
 #include <pugixml.hpp>
+#include "xa_xml_node_table.h"
 
 class QPaintEvent;
 class QResizeEvent;
@@ -28,7 +29,6 @@ class QWidget;
 class LineNumberArea;
 class XAApp;
 class XATheme;
-class XAXMLTreeItem;
 
 class XAEditor : public QPlainTextEdit
 {
@@ -40,7 +40,28 @@ public:
     void lineNumberAreaPaintEvent(QPaintEvent *event);
     int lineNumberAreaWidth();
 
-    void markSelectedRange(const XAXMLTreeItem* item);
+    /**
+     * Highlights the text of a tree item, offset and end_offset are its current span in the editor
+     * A range marks all its elements.
+     */
+    void markSelectedRange(XAXMLTreeItemType type, int64_t offset, int64_t end_offset);
+
+    /**
+     * Highlights start and end tag of the element at offset to end_offset while the cursor is in one of them
+     * offset is the element offset of the tree item, a negative one removes the highlight.
+     */
+    void markMatchingTags(int64_t offset, int64_t end_offset);
+
+    /**
+     * Selects the text of a tree item, offsets as for markSelectedRange
+     */
+    void selectRange(XAXMLTreeItemType type, int64_t offset, int64_t end_offset);
+
+signals:
+    /**
+     * The block numbers on screen changed, after scrolling, resizing or editing
+     */
+    void visibleBlocksChanged(int first, int last);
 
 protected:
     void resizeEvent(QResizeEvent *event) override;
@@ -51,12 +72,19 @@ private slots:
     void updateLineNumberArea(const QRect &rect, int dy);
 
 private:
-    size_t findFirstElementPos(const XAXMLTreeItem* item);
-    size_t findEndElementPos(const XAXMLTreeItem* item);
+    int64_t findFirstElementPos(XAXMLTreeItemType type, int64_t offset);
+    int64_t findStartTagEnd(int64_t offset, int64_t end_offset) const;
+    int64_t findEndTagStart(int64_t offset, int64_t end_offset) const;
+    void updateExtraSelections();
+    void updateVisibleBlocks();
 
 private:
     QWidget *lineNumberArea;
     XATheme* m_theme;
+    QList<QTextEdit::ExtraSelection> m_marked_selections;
+    QList<QTextEdit::ExtraSelection> m_tag_selections;
+    int m_first_visible_block;
+    int m_last_visible_block;
 };
 
 
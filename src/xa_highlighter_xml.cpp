@@ -17,291 +17,632 @@
 
 #include "xa_highlighter_xml.h"
 #include "xa_app.h"
+#include "xa_byte_scan.h"
 #include "xa_theme.h"
+#include "xa_token_stream.h"
+#include <QElapsedTimer>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextLayout>
+#include <QTimer>
+#include <algorithm>
+#include <vector>
 
 
-XAHighlighter_XML::XAHighlighter_XML(XAApp* app, QTextDocument* parent)
-    : QSyntaxHighlighter(parent)
-    , m_app(app)
+namespace
 {
-    init();
-}
+    /**
+     * Where a block ends, kept as block state so the next block continues there
+     */
+    enum BlockState
+    {
+        TEXT = 0,
+        COMMENT,
+        CDATA,
+        START_TAG,
+        START_TAG_VALUE,
+        START_TAG_VALUE_SINGLE,
+        END_TAG,
+        PROCESSING_INSTRUCTION,
+        PI_VALUE,
+        PI_VALUE_SINGLE,
+        DECLARATION
+    };
+
+    /**
+     * The block state keeps the lexer state in the low bits.
+     * Formatted: the block has its formats, otherwise only the state was carried through it.
+     * Pending: nothing is known about the block yet, the state of the previous block was unknown.
+     */
+    enum BlockStateFlags
+    {
+        StateMask = 0xff,
+        Formatted = 0x100,
+        Pending = 0x200
+    };
 
-void XAHighlighter_XML::highlightBlock(const QString& text)
-{
-    auto line = text.toStdString();
-
-    // apply the line highlighting rules
-    for (const HighlightingRule &rule : std::as_const(m_line_rules)) {
-        QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
-        while (matchIterator.hasNext()) {
-            QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.format);
-        }
-    }
+    // documents above this many characters are only highlighted where they are shown
+    const int LazyHighlightLimit = 8 * 1024 * 1024;
 
-    setCurrentBlockState(0);
+    // milliseconds of highlighting per idle time slice
+    const int IdleSlice = 8;
 
-    // apply multi-line rules
+    /**
+     * Token classes of a formatted block, so a theme change only has to map them to new formats
+     */
+    class XABlockTokens : public QTextBlockUserData
+    {
+    public:
+        struct Token
+        {
+            int   start;
+            int   count;
+            XMLSE element;
+        };
+
+        std::vector<Token> tokens;
+        int                generation = 0;
+        int                parsed = -1;     // token stream generation the block was formatted from
+    };
+
+    // element class of each XATokenStream::Kind
+    const XMLSE TokenElements[] =
+    {
+        XMLSE::XML_ELEM,
+        XMLSE::XML_ATTR,
+        XMLSE::XML_ATTR_VALUE,
+        XMLSE::XML_COMMENT,
+        XMLSE::XML_CDATA,
+        XMLSE::XML_PI,
+        XMLSE::XML_PI_VALUE,
+    };
+
+    inline bool isKnown(int state)
+    {
+        return state >= 0 && !(state & Pending);
+    }
 
-    int startIndex = 0;
-    if (previousBlockState() != 1) {
-        startIndex = text.indexOf("<!--");
+    inline bool isFormatted(int state)
+    {
+        return isKnown(state) && (state & Formatted);
     }
 
-    while (startIndex >= 0) {
-        int endIndex = text.indexOf("-->", startIndex);
-        int commentLength;
-        if (endIndex == -1) {
-            setCurrentBlockState(1);
-            commentLength = text.length() - startIndex;
-        }
-        else {
-            commentLength = endIndex - startIndex + 3;
-        }
-        setFormat(startIndex, commentLength, m_format_map.at(static_cast<int>(XMLSE::XML_MULTILINE_COMMENT)));
-        startIndex = text.indexOf("<!--", startIndex + commentLength);
+    inline bool isNameStart(QChar c)
+    {
+        return c.isLetter() || c == QLatin1Char('_') || c == QLatin1Char(':');
     }
 
-    // Handle multi-line CDATA sections
-    startIndex = 0;
-    if (previousBlockState() != 2) {
-        startIndex = text.indexOf("<![CDATA[");
+    inline bool isNameChar(QChar c)
+    {
+        return c.isLetterOrNumber() || c == QLatin1Char('_') || c == QLatin1Char(':')
+            || c == QLatin1Char('-') || c == QLatin1Char('.');
     }
 
-    while (startIndex >= 0) {
-        int endIndex = text.indexOf("]]>", startIndex);
-        int cdataLength;
-        if (endIndex == -1) {
-            setCurrentBlockState(2);
-            cdataLength = text.length() - startIndex;
-        }
-        else {
-            cdataLength = endIndex - startIndex + 3;
+    inline bool startsWith(const QChar* text, int length, int pos, const char* prefix)
+    {
+        for (; *prefix; ++prefix, ++pos)
+        {
+            if (pos >= length || text[pos] != QLatin1Char(*prefix))
+                return false;
         }
-        setFormat(startIndex, cdataLength, m_format_map.at(static_cast<int>(XMLSE::XML_CDATA)));
-        startIndex = text.indexOf("<![CDATA[", startIndex + cdataLength);
+        return true;
     }
 
-    // Handle XML elements
+    int indexOf(const QChar* text, int length, int pos, const char* pattern)
     {
-        // <ABC
-        auto elem = m_element_start_pattern.match(text);
-        while (elem.hasMatch()) {
-            int elementStart = elem.capturedStart();
-            int elementEnd = elem.capturedEnd();
-            auto debug = text.mid(elementStart, elementEnd - elementStart).toStdString();
-            setFormat(elementStart, elementEnd - elementStart, m_format_map.at(static_cast<int>(XMLSE::XML_ELEM)));
-            elem = m_element_start_pattern.match(text, elementEnd);
-
-            // <ABC ...  we are ready to handle attributes
-            setCurrentBlockState(3);
-
-            // attributes
-            {
-                auto attr_name = m_attribute_name.match(text, elementEnd);
-                while (attr_name.hasMatch())
-                {
-                    int attrStart = attr_name.capturedStart();
-                    int attrEnd = attr_name.capturedEnd();
-                    setFormat(attrStart, attrEnd - attrStart, m_format_map.at(static_cast<int>(XMLSE::XML_ATTR)));
-                    attr_name = m_attribute_name.match(text, attrEnd);
-                    // attribute value
-                    auto attr_value = m_attribute_value.match(text, attrEnd);
-                    if (attr_value.hasMatch())
-                    {
-                        int attrValueStart = attr_value.capturedStart();
-                        int attrValueEnd = attr_value.capturedEnd();
-                        setFormat(attrValueStart, attrValueEnd - attrValueStart, m_format_map.at(static_cast<int>(XMLSE::XML_ATTR_VALUE)));
-                    }
-                }
-            }
-
-            {   // >
-                auto cm = m_element_closing_pattern.match(text, elementEnd);
-                if (cm.hasMatch()) {
-                    int elementStart = cm.capturedStart();
-                    int elementEnd = cm.capturedEnd();
-                    auto debug2 = text.mid(elementStart, elementEnd - elementStart).toStdString();
-                    setFormat(elementStart, elementEnd - elementStart, m_format_map.at(static_cast<int>(XMLSE::XML_ELEM)));
-                }
-            }
+        // the scan jumps to candidates for the first character, the rest is compared there
+        const XAByteScan scan(pattern, 1);
+        auto utf16 = reinterpret_cast<const char16_t*>(text);
+        while (pos < length)
+        {
+            pos = static_cast<int>(scan.find(utf16, length, pos));
+            if (pos >= length)
+                break;
+            if (startsWith(text, length, pos, pattern))
+                return pos;
+            ++pos;
         }
+        return -1;
+    }
 
-        // </ABC>
-        auto elementEndMatch = m_element_end_pattern.match(text);
-        while (elementEndMatch.hasMatch()) {
-            int elementStart = elementEndMatch.capturedStart();
-            int elementEnd = elementEndMatch.capturedEnd();
-            setFormat(elementStart, elementEnd - elementStart, m_format_map.at(static_cast<int>(XMLSE::XML_ELEM)));
-            elementEndMatch = m_element_end_pattern.match(text, elementEnd);
-        }
+    int skipName(const QChar* text, int length, int pos)
+    {
+        while (pos < length && isNameChar(text[pos]))
+            ++pos;
+        return pos;
     }
-    
-    // Handle XML attributes
+
+    /**
+     * Formats one block in a single pass, starting in state, returns the state at its end
+     * format(start, count, element) is called for each token, in text order.
+     */
+    template<typename Format>
+    int lexBlock(const QChar* text, int length, int state, Format&& format)
     {
-        // <ABC ...  we are ready to handle attributes
-        if (previousBlockState() == 3)
+        int pos = 0;
+        while (pos < length)
         {
-            // attributes
+            switch (state)
+            {
+            case COMMENT:
+            case CDATA:
+            {
+                // the opening sequence was left to this state, so it is formatted alike
+                auto end = indexOf(text, length, pos, state == COMMENT ? "-->" : "]]>");
+                auto stop = (end < 0) ? length : end + 3;
+                format(pos, stop - pos, state == COMMENT ? XMLSE::XML_MULTILINE_COMMENT : XMLSE::XML_CDATA);
+                pos = stop;
+                if (end >= 0)
+                    state = TEXT;
+            } break;
+
+            case TEXT:
             {
-                auto attr_name = m_attribute_name.match(text);
-                while (attr_name.hasMatch())
+                auto lt = indexOf(text, length, pos, "<");
+                if (lt < 0)
                 {
-                    int attrStart = attr_name.capturedStart();
-                    int attrEnd = attr_name.capturedEnd();
-                    setFormat(attrStart, attrEnd - attrStart, m_format_map.at(static_cast<int>(XMLSE::XML_ATTR)));
-                    auto debug = text.mid(attrStart, attrEnd - attrStart).toStdString();
-
-                    // attribute value
-                    auto attr_value = m_attribute_value.match(text, attrEnd);
-                    int attrValueEnd = 0;
-                    if (attr_value.hasMatch())
-                    {
-                        int attrValueStart = attr_value.capturedStart();
-                        attrValueEnd = attr_value.capturedEnd();
-                        setFormat(attrValueStart, attrValueEnd - attrValueStart, m_format_map.at(static_cast<int>(XMLSE::XML_ATTR_VALUE)));
-                        debug = text.mid(attrValueStart, attrValueEnd - attrValueStart).toStdString();
-                    }
-                    else
-                    {
-                        break;
-                    }
-                    attr_name = m_attribute_name.match(text, attrValueEnd);
+                    pos = length;
+                    break;
+                }
+                pos = lt;
 
-                    // >
-                    auto cm = m_element_closing_pattern.match(text, attrValueEnd);
-                    if (cm.hasMatch())
-                    {
-                        int elementStart = cm.capturedStart();
-                        int elementEnd = cm.capturedEnd();
-                        auto debug2 = text.mid(elementStart, elementEnd - elementStart).toStdString();
-                        setFormat(elementStart, elementEnd - elementStart, m_format_map.at(static_cast<int>(XMLSE::XML_ELEM)));
-                        setCurrentBlockState(0);
-                        break;
-                    }
-                    else
+                if (startsWith(text, length, pos, "<!--"))
+                {
+                    state = COMMENT;
+                }
+                else if (startsWith(text, length, pos, "<![CDATA["))
+                {
+                    state = CDATA;
+                }
+                else if (startsWith(text, length, pos, "<?"))
+                {
+                    auto name_end = skipName(text, length, pos + 2);
+                    // the XML declaration is set off as a whole, its parts are formatted on top
+                    if (name_end - pos == 5 && startsWith(text, length, pos, "<?xml"))
                     {
-                        // still in the same element
-                        setCurrentBlockState(3);
+                        auto end = indexOf(text, length, name_end, "?>");
+                        format(pos, ((end < 0) ? length : end + 2) - pos, XMLSE::XML_PROLOG);
                     }
-                    
+                    format(pos, 2, XMLSE::XML_ELEM);
+                    format(pos + 2, name_end - pos - 2, XMLSE::XML_PI);
+                    pos = name_end;
+                    state = PROCESSING_INSTRUCTION;
+                }
+                else if (startsWith(text, length, pos, "</"))
+                {
+                    state = END_TAG;
+                }
+                else if (startsWith(text, length, pos, "<!"))
+                {
+                    pos += 2;
+                    state = DECLARATION;
+                }
+                else if (pos + 1 < length && isNameStart(text[pos + 1]))
+                {
+                    auto name_end = skipName(text, length, pos + 1);
+                    format(pos, name_end - pos, XMLSE::XML_ELEM);
+                    pos = name_end;
+                    state = START_TAG;
+                }
+                else
+                {
+                    ++pos;
+                }
+            } break;
 
+            case START_TAG:
+            case PROCESSING_INSTRUCTION:
+            {
+                auto c = text[pos];
+                bool tag = state == START_TAG;
+                if (c.isSpace() || c == QLatin1Char('='))
+                {
+                    ++pos;
+                }
+                else if (tag && (c == QLatin1Char('>') || startsWith(text, length, pos, "/>")))
+                {
+                    auto size = (c == QLatin1Char('>')) ? 1 : 2;
+                    format(pos, size, XMLSE::XML_ELEM);
+                    pos += size;
+                    state = TEXT;
                 }
+                else if (!tag && startsWith(text, length, pos, "?>"))
+                {
+                    format(pos, 2, XMLSE::XML_ELEM);
+                    pos += 2;
+                    state = TEXT;
+                }
+                else if (c == QLatin1Char('"') || c == QLatin1Char('\''))
+                {
+                    // the quote is formatted by the value state
+                    bool single = c == QLatin1Char('\'');
+                    format(pos, 1, XMLSE::XML_ATTR_VALUE);
+                    ++pos;
+                    state = tag ? (single ? START_TAG_VALUE_SINGLE : START_TAG_VALUE) : (single ? PI_VALUE_SINGLE : PI_VALUE);
+                }
+                else if (isNameStart(c))
+                {
+                    // a name is an attribute if a '=' follows, in an instruction it can be plain content
+                    auto name_end = skipName(text, length, pos);
+                    auto next = name_end;
+                    while (next < length && text[next].isSpace())
+                        ++next;
+                    bool attribute = tag || (next < length && text[next] == QLatin1Char('='));
+                    format(pos, name_end - pos, attribute ? XMLSE::XML_ATTR : XMLSE::XML_PI_VALUE);
+                    pos = name_end;
+                }
+                else
+                {
+                    if (!tag)
+                        format(pos, 1, XMLSE::XML_PI_VALUE);
+                    ++pos;
+                }
+            } break;
 
+            case START_TAG_VALUE:
+            case START_TAG_VALUE_SINGLE:
+            case PI_VALUE:
+            case PI_VALUE_SINGLE:
+            {
+                bool single = state == START_TAG_VALUE_SINGLE || state == PI_VALUE_SINGLE;
+                auto end = indexOf(text, length, pos, single ? "'" : "\"");
+                auto stop = (end < 0) ? length : end + 1;
+                format(pos, stop - pos, XMLSE::XML_ATTR_VALUE);
+                pos = stop;
+                if (end >= 0)
+                    state = (state == START_TAG_VALUE || state == START_TAG_VALUE_SINGLE) ? START_TAG : PROCESSING_INSTRUCTION;
+            } break;
+
+            case END_TAG:
+            {
+                auto end = indexOf(text, length, pos, ">");
+                auto stop = (end < 0) ? length : end + 1;
+                format(pos, stop - pos, XMLSE::XML_ELEM);
+                pos = stop;
+                if (end >= 0)
+                    state = TEXT;
+            } break;
+
+            case DECLARATION:
+            default:
+            {
+                // DOCTYPE and the like are left as they are
+                auto end = indexOf(text, length, pos, ">");
+                pos = (end < 0) ? length : end + 1;
+                if (end >= 0)
+                    state = TEXT;
+            } break;
             }
         }
+        return state;
+    }
+}
+
+
+XAHighlighter_XML::XAHighlighter_XML(XAApp* app, QTextDocument* parent)
+    : QSyntaxHighlighter(static_cast<QTextDocument*>(nullptr))
+    , m_app(app)
+    , m_visible_timer(new QTimer(this))
+    , m_idle_timer(new QTimer(this))
+    , m_visible_first(0)
+    , m_visible_last(0)
+    , m_idle_block(0)
+    , m_forced_block(-1)
+    , m_color_generation(0)
+    , m_tokens()
+    , m_token_generation(0)
+{
+    updateFormatMap();
+
+    // connected ahead of QSyntaxHighlighter, a token stream has to be dropped before the changed blocks are reformatted
+    setParent(parent);
+    connect(parent, &QTextDocument::contentsChange, this, &XAHighlighter_XML::onContentsChange);
+    setDocument(parent);
+
+    m_visible_timer->setSingleShot(true);
+    m_visible_timer->setInterval(0);
+    connect(m_visible_timer, &QTimer::timeout, this, &XAHighlighter_XML::highlightVisible);
+
+    m_idle_timer->setSingleShot(true);
+    m_idle_timer->setInterval(0);
+    connect(m_idle_timer, &QTimer::timeout, this, &XAHighlighter_XML::highlightIdle);
+}
+
+void XAHighlighter_XML::highlightBlock(const QString& text)
+{
+    auto block = currentBlock();
+    auto stored = currentBlockState();
+    auto previous = previousBlockState();
+    auto first_block = !block.previous().isValid();
+
+    // where the previous block ends is unknown, the view scan fills it in when needed
+    if (!first_block && !isKnown(previous))
+    {
+        setCurrentBlockUserData(nullptr);
+        setCurrentBlockState(Pending);
+        return;
     }
 
-    // Processing instruction
+    auto state = first_block ? static_cast<int>(TEXT) : previous & StateMask;
+    if (isWanted(block.blockNumber(), stored))
     {
-        auto proc_instr = m_processing_instruction.match(text);
-        if (proc_instr.hasMatch())
+        auto data = static_cast<XABlockTokens*>(currentBlockUserData());
+        if (!data)
         {
-            {
-                int piStart = proc_instr.capturedStart();
-                int piEnd = proc_instr.capturedEnd();
-                setFormat(piStart, piEnd - piStart, m_format_map.at(static_cast<int>(XMLSE::XML_ELEM)));
-            }
+            data = new XABlockTokens;
+            setCurrentBlockUserData(data);
+        }
+        data->tokens.clear();
+        data->generation = m_color_generation;
+        data->parsed = m_tokens ? m_token_generation : -1;
 
-            int piNameStart = proc_instr.capturedStart(1);
-            int piNameEnd = proc_instr.capturedEnd(1);
-            auto debug = text.mid(piNameStart, piNameEnd - piNameStart).toStdString();
-            setFormat(piNameStart, piNameEnd - piNameStart, m_format_map.at(static_cast<int>(XMLSE::XML_PI)));
+        auto format = [this, data](int start, int count, XMLSE element) {
+            data->tokens.push_back({ start, count, element });
+            setFormat(start, count, m_format_map.at(static_cast<int>(element)));
+        };
 
-            // attributes or other
+        if (!m_tokens)
+        {
+            state = lexBlock(text.constData(), text.size(), state, format);
+        }
+        else
+        {
+            // the parse has the formats, the lexer only runs if the tokens leave the end state open
+            auto position = block.position();
+            auto block_end = position + text.size();
+            for (auto it = m_tokens->find(position); it != m_tokens->end() && it->start < block_end; ++it)
             {
-                auto attr_name = m_attribute_name.match(text, piNameEnd);
-                if (attr_name.hasMatch())
+                // the XML declaration is set off as a whole like the lexer does, its parts are formatted on top
+                auto next = it + 1;
+                if (it->kind == XATokenStream::ELEMENT && it->start >= position && next != m_tokens->end()
+                    && next->kind == XATokenStream::PI_TARGET && next->start == it->start + 2 && next->length == 3
+                    && startsWith(text.constData(), text.size(), it->start - position, "<?xml"))
                 {
-                    while (attr_name.hasMatch())
-                    {
-                        int attrStart = attr_name.capturedStart();
-                        int attrEnd = attr_name.capturedEnd();
-                        setFormat(attrStart, attrEnd - attrStart, m_format_map.at(static_cast<int>(XMLSE::XML_ATTR)));
-                        attr_name = m_attribute_name.match(text, attrEnd);
-                        // attribute value
-                        auto attr_value = m_attribute_value.match(text, attrEnd);
-                        if (attr_value.hasMatch())
-                        {
-                            int attrValueStart = attr_value.capturedStart();
-                            int attrValueEnd = attr_value.capturedEnd();
-                            setFormat(attrValueStart, attrValueEnd - attrValueStart, m_format_map.at(static_cast<int>(XMLSE::XML_ATTR_VALUE)));
-                        }
-                    }
-                }
-                else
-                {
-                    int piContentStart = proc_instr.capturedStart(2);
-                    int piContentEnd = proc_instr.capturedEnd(2);
-                    auto debug = text.mid(piContentStart, piContentEnd - piContentStart).toStdString();
-                    setFormat(piContentStart, piContentEnd - piContentStart, m_format_map.at(static_cast<int>(XMLSE::XML_PI_VALUE)));
+                    auto close = next + 1;
+                    while (close != m_tokens->end() && close->kind != XATokenStream::ELEMENT)
+                        ++close;
+                    auto stop = (close == m_tokens->end()) ? block_end : std::min(close->start + close->length, block_end);
+                    format(it->start - position, stop - it->start, XMLSE::XML_PROLOG);
                 }
+
+                auto start = std::max(it->start, position);
+                auto stop = std::min(it->start + it->length, block_end);
+                if (stop > start)
+                    format(start - position, stop - start, TokenElements[it->kind]);
             }
 
+            auto end_state = stateFromTokens(text, position);
+            state = (end_state >= 0) ? end_state : lexBlock(text.constData(), text.size(), state, [](int, int, XMLSE) {});
         }
+        setCurrentBlockState(state | Formatted);
+        return;
     }
 
+    // only formatted blocks keep their tokens
+    setCurrentBlockUserData(nullptr);
+    if (isKnown(stored) || (stored < 0 && document()->characterCount() <= LazyHighlightLimit))
+    {
+        // out of view, only the state is carried on so the blocks below stay right
+        state = lexBlock(text.constData(), text.size(), state, [](int, int, XMLSE) {});
+        setCurrentBlockState(state);
+    }
+    else
+    {
+        setCurrentBlockState(Pending);
+    }
 }
 
-void XAHighlighter_XML::onThemeChange()
+int XAHighlighter_XML::stateFromTokens(const QString& text, int position) const
 {
-    init();
-    rehighlight();
+    auto doc = document();
+    auto block_end = position + text.size();
+
+    // a token running over the line break leaves the block inside of it
+    auto it = m_tokens->find(block_end);
+    if (it != m_tokens->end() && it->start <= block_end)
+    {
+        switch (it->kind)
+        {
+        case XATokenStream::COMMENT:
+            return COMMENT;
+        case XATokenStream::CDATA:
+            return CDATA;
+        case XATokenStream::ELEMENT:
+            // only an end tag is a single token that can span lines
+            return (doc->characterAt(it->start + 1) == QLatin1Char('/')) ? static_cast<int>(END_TAG) : -1;
+        default:
+            return -1;
+        }
+    }
+
+    // behind the '>' of a tag the block ends in text, unless untokenized markup like a DOCTYPE follows
+    if (it == m_tokens->begin())
+        return -1;
+    auto last = it - 1;
+    auto last_end = last->start + last->length;
+    if (last->kind != XATokenStream::ELEMENT || doc->characterAt(last_end - 1) != QLatin1Char('>'))
+        return -1;
+    auto rest = std::max(last_end - position, 0);
+    return (indexOf(text.constData(), text.size(), rest, "<") < 0) ? static_cast<int>(TEXT) : -1;
 }
 
+bool XAHighlighter_XML::isWanted(int block_number, int stored_state) const
+{
+    return block_number == m_forced_block
+        || (block_number >= m_visible_first && block_number <= m_visible_last)
+        || isFormatted(stored_state);
+}
 
-void XAHighlighter_XML::init()
+bool XAHighlighter_XML::isStale(const QTextBlock& block) const
 {
-    HighlightingRule rule;
+    auto data = static_cast<XABlockTokens*>(block.userData());
+    return data && data->generation != m_color_generation;
+}
 
-    updateFormatMap();
+bool XAHighlighter_XML::needsTokens(const QTextBlock& block) const
+{
+    auto data = static_cast<XABlockTokens*>(block.userData());
+    return m_tokens && data && data->parsed != m_token_generation;
+}
 
-    m_line_rules.clear();
+void XAHighlighter_XML::recolorBlock(const QTextBlock& block)
+{
+    auto data = static_cast<XABlockTokens*>(block.userData());
+
+    // tokens can overlap, the XML declaration is formatted as a whole and its parts on top
+    // setFormats merges overlapping ranges, so the classes are laid out per character first,
+    // later tokens overwrite earlier ones as setFormat does
+    auto length = std::max(block.length() - 1, 0);
+    std::vector<int> classes(static_cast<size_t>(length), -1);
+    for (const auto& token : data->tokens)
+    {
+        auto start = std::max(token.start, 0);
+        auto stop = std::min(token.start + token.count, length);
+        std::fill(classes.begin() + std::min(start, stop), classes.begin() + stop, static_cast<int>(token.element));
+    }
 
-    // line rules
-    {   // Processing instruction
-        //rule.pattern = QRegularExpression(QStringLiteral("<\\?.*\\?>"));
-        //rule.format = m_format_map.at(static_cast<int>(XMLSE::XML_PI));
-        //m_line_rules.append(rule);
+    QVector<QTextLayout::FormatRange> ranges;
+    ranges.reserve(static_cast<int>(data->tokens.size()));
+    for (int pos = 0; pos < length;)
+    {
+        auto element = classes[pos];
+        auto stop = pos + 1;
+        while (stop < length && classes[stop] == element)
+            ++stop;
 
-        //<?xml version="1.0" encoding="UTF-8"?>
-        rule.pattern = QRegularExpression(QStringLiteral("<\\?xml.*>"));
-        rule.format = m_format_map.at(static_cast<int>(XMLSE::XML_PROLOG));
-        m_line_rules.append(rule);
+        if (element >= 0)
+        {
+            QTextLayout::FormatRange range;
+            range.start = pos;
+            range.length = stop - pos;
+            range.format = m_format_map.at(element);
+            ranges.append(range);
+        }
+        pos = stop;
+    }
+
+    block.layout()->setFormats(ranges);
+    data->generation = m_color_generation;
+    document()->markContentsDirty(block.position(), block.length());
+}
 
-        //<!-- comment -->
-        rule.pattern = QRegularExpression(QStringLiteral("<!--[^>]*-->"));
-        rule.format = m_format_map.at(static_cast<int>(XMLSE::XML_COMMENT));
-        m_line_rules.append(rule);
+void XAHighlighter_XML::setVisibleBlocks(int first, int last)
+{
+    if (first == m_visible_first && last == m_visible_last)
+        return;
 
+    m_visible_first = first;
+    m_visible_last = last;
+    m_visible_timer->start();
+}
+
+void XAHighlighter_XML::setTokenStream(std::shared_ptr<const XATokenStream> tokens)
+{
+    m_tokens = std::move(tokens);
+    ++m_token_generation;
+    if (!m_tokens)
+        return;
+
+    // blocks lexed so far are formatted again from the tokens, the view first
+    m_idle_block = 0;
+    highlightVisible();
+    m_idle_timer->start();
+}
+
+void XAHighlighter_XML::onContentsChange(int position, int /* chars_removed */, int /* chars_added */)
+{
+    // token positions are off after any change
+    m_tokens.reset();
+
+    // a new text leaves the view pending, blocks after an edit may have lost their formats
+    auto block = document()->findBlock(position);
+    if (block.isValid())
+    {
+        m_idle_block = std::min(m_idle_block, block.blockNumber());
+    }
+
+    m_visible_timer->start();
+    m_idle_timer->start();
+}
+
+void XAHighlighter_XML::highlightVisible()
+{
+    auto doc = document();
+    auto first = doc->findBlockByNumber(m_visible_first);
+    if (!first.isValid())
+        return;
+
+    // the block above the view has to know where it ends, carry the state down from the last known block
+    auto known = first.previous();
+    while (known.isValid() && !isKnown(known.userState()))
+    {
+        known = known.previous();
     }
 
-    // (potential) multi-line rules
-    {   //<!-- multi-line comment -->
-        rule.pattern = QRegularExpression(QStringLiteral("<!--"));
-        rule.format = m_format_map.at(static_cast<int>(XMLSE::XML_MULTILINE_COMMENT));
+    auto state = known.isValid() ? known.userState() & StateMask : static_cast<int>(TEXT);
+    for (auto block = known.isValid() ? known.next() : doc->firstBlock(); block != first; block = block.next())
+    {
+        auto text = block.text();
+        state = lexBlock(text.constData(), text.size(), state, [](int, int, XMLSE) {});
+        block.setUserState(state);
+    }
 
-        //<![CDATA[ ... ]]>
-        rule.pattern = QRegularExpression(QStringLiteral("<!\\[CDATA\\[.*\\]\\]>"));
-        rule.format = m_format_map.at(static_cast<int>(XMLSE::XML_CDATA));
+    for (auto block = first; block.isValid() && block.blockNumber() <= m_visible_last; block = block.next())
+    {
+        if (!isFormatted(block.userState()) || needsTokens(block))
+        {
+            rehighlightBlock(block);
+        }
+        else if (isStale(block))
+        {
+            recolorBlock(block);
+        }
+    }
+}
 
-        //<ABC
-        m_element_start_pattern = QRegularExpression(QStringLiteral("<([a-zA-Z_][\\w\\-\\.]*)"));
-        m_element_closing_pattern = QRegularExpression(QStringLiteral(">(?=(?:[^\"]*\"[^\"]*\")*[^\"]*$)"));
-        m_element_end_pattern = QRegularExpression(QStringLiteral("</([a-zA-Z_][\\w\\-\\.]*)>")); 
+void XAHighlighter_XML::highlightIdle()
+{
+    auto doc = document();
+    if (doc->characterCount() > LazyHighlightLimit)
+        return;
 
-        // XML attribute name
-        m_attribute_name = QRegularExpression(QStringLiteral("\\b[a-zA-Z_][\\w\\-\\.]*\\b(?=\\s*=)"));
+    QElapsedTimer elapsed;
+    elapsed.start();
 
-        // XML Attribute value
-        m_attribute_value = QRegularExpression(QStringLiteral("\"[^\"]*\""));
+    // all blocks above m_idle_block are formatted, so each block here knows its starting state
+    auto block = doc->findBlockByNumber(m_idle_block);
+    while (block.isValid() && elapsed.elapsed() < IdleSlice)
+    {
+        if (!isFormatted(block.userState()) || needsTokens(block))
+        {
+            m_forced_block = block.blockNumber();
+            rehighlightBlock(block);
+            m_forced_block = -1;
+        }
+        else if (isStale(block))
+        {
+            recolorBlock(block);
+        }
+        block = block.next();
+    }
 
-        // Processing instruction
-        m_processing_instruction = QRegularExpression(QStringLiteral("<\\?([a-zA-Z_][\\w\\-\\.]*)(.*)\\?>"));
+    m_idle_block = block.isValid() ? block.blockNumber() : doc->blockCount();
+    if (block.isValid())
+    {
+        m_idle_timer->start();
     }
 }
 
+void XAHighlighter_XML::onThemeChange()
+{
+    updateFormatMap();
+    ++m_color_generation;
+
+    m_idle_block = 0;
+    highlightVisible();
+    m_idle_timer->start();
+}
+
 
 void XAHighlighter_XML::updateFormatMap()
 {
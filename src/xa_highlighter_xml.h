@@ -19,12 +19,15 @@
 
 #include <QSyntaxHighlighter>
 #include <QTextCharFormat>
-#include <QRegularExpression>
 #include <map>
+#include <memory>
 
+class QTextBlock;
 class QTextDocument;
 class QTextEdit;
+class QTimer;
 class XAApp;
+class XATokenStream;
 
 enum class XMLSE
 {
@@ -47,33 +50,48 @@ class XAHighlighter_XML : public QSyntaxHighlighter
 public:
     XAHighlighter_XML(XAApp* app, QTextDocument* parent);
 
+    /**
+     * Maps the token classes kept per block to the formats of the new theme, nothing is lexed again.
+     * Visible blocks change at once, the others in idle time or when they are scrolled into view.
+     */
     void onThemeChange();
 
+    /**
+     * Blocks first to last are on screen, they are highlighted before any other block.
+     * The rest of the document follows in idle time slices, not at all for large documents.
+     */
+    void setVisibleBlocks(int first, int last);
+
+    /**
+     * Formats blocks from the markup tokens of the parse instead of lexing them, tokens has to match the current text.
+     * The stream is dropped on the next edit, changed blocks are lexed until a new one is set.
+     */
+    void setTokenStream(std::shared_ptr<const XATokenStream> tokens);
+
 protected:
     virtual void highlightBlock(const QString& text);
 
 private:
-
-    void init();
     void updateFormatMap();
+    void onContentsChange(int position, int chars_removed, int chars_added);
+    void highlightVisible();
+    void highlightIdle();
+    int stateFromTokens(const QString& text, int position) const;
+    bool isWanted(int block_number, int stored_state) const;
+    bool isStale(const QTextBlock& block) const;
+    bool needsTokens(const QTextBlock& block) const;
+    void recolorBlock(const QTextBlock& block);
 
 private:
     XAApp* m_app;
     std::map<int, QTextCharFormat>  m_format_map;
-
-    struct HighlightingRule
-    {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-    };
-    QList<HighlightingRule> m_line_rules;
-
-    QRegularExpression m_element_start_pattern;
-    QRegularExpression m_element_closing_pattern;
-    QRegularExpression m_element_end_pattern;
-
-    QRegularExpression m_attribute_name;
-    QRegularExpression m_attribute_value;
-
-    QRegularExpression m_processing_instruction;
+    QTimer* m_visible_timer;
+    QTimer* m_idle_timer;
+    int     m_visible_first;
+    int     m_visible_last;
+    int     m_idle_block;
+    int     m_forced_block;
+    int     m_color_generation;
+    std::shared_ptr<const XATokenStream> m_tokens;
+    int     m_token_generation;
 };
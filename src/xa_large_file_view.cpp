@@ -0,0 +1,514 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xa_large_file_view.h"
+#include <QApplication>
+#include <QClipboard>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <algorithm>
+#include <climits>
+#include "xa_app.h"
+#include "xa_theme.h"
+
+
+namespace
+{
+    // space between the line numbers and the text
+    const int TextMargin = 4;
+
+    // columns a tab advances to
+    const int TabWidth = 4;
+
+    // columns per nesting level of a broken line
+    const int IndentWidth = 2;
+
+    // bytes the clipboard gets at most, a QString holds no more than 2G characters anyway
+    const int64_t MaxCopyLength = 64 * 1024 * 1024;
+
+    inline bool isContinuation(char c)
+    {
+        return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+    }
+}
+
+
+XALargeFileView::XALargeFileView(XAApp* app, QWidget* parent)
+    : QAbstractScrollArea(parent)
+    , m_theme(app->getTheme())
+    , m_data(nullptr)
+    , m_size(0)
+    , m_rows()
+    , m_cursor(0)
+    , m_anchor(0)
+    , m_mark_start(-1)
+    , m_mark_end(-1)
+{
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setCursor(Qt::IBeamCursor);
+    clear();
+}
+
+void XALargeFileView::setBuffer(const char* data, size_t size, std::shared_ptr<const XARowIndex> rows)
+{
+    m_data = data;
+    m_size = size;
+    m_rows = rows ? std::move(rows) : std::make_shared<XARowIndex>();
+    m_cursor = 0;
+    m_anchor = 0;
+    m_mark_start = -1;
+    m_mark_end = -1;
+
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    updateScrollBars();
+    viewport()->update();
+    emit cursorPositionChanged();
+}
+
+void XALargeFileView::clear()
+{
+    setBuffer(nullptr, 0, nullptr);
+}
+
+int64_t XALargeFileView::cursorPosition() const
+{
+    return m_cursor;
+}
+
+int64_t XALargeFileView::selectionStart() const
+{
+    return std::min(m_anchor, m_cursor);
+}
+
+int64_t XALargeFileView::selectionEnd() const
+{
+    return std::max(m_anchor, m_cursor);
+}
+
+void XALargeFileView::markSelectedRange(XAXMLTreeItemType type, int64_t offset, int64_t end_offset)
+{
+    // element offsets point at the name, the mark starts with the bracket
+    auto start = (type == XAXMLTreeItemType::ATTRIBUTE) ? offset : offset - 1;
+    start = std::max<int64_t>(0, start);
+
+    m_mark_start = start;
+    m_mark_end = std::max(start, end_offset);
+    moveCursor(start, false);
+}
+
+void XALargeFileView::selectRange(XAXMLTreeItemType type, int64_t offset, int64_t end_offset)
+{
+    auto start = (type == XAXMLTreeItemType::ATTRIBUTE) ? offset : offset - 1;
+    if (start < 0 || end_offset < start)
+        return;
+
+    moveCursor(start, false);
+    moveCursor(end_offset, true);
+}
+
+void XALargeFileView::copy()
+{
+    auto start = selectionStart();
+    auto end = selectionEnd();
+    if (start == end)
+        return;
+
+    if (end - start > MaxCopyLength)
+    {
+        emit copyRefused(end - start, MaxCopyLength);
+        return;
+    }
+
+    QApplication::clipboard()->setText(QString::fromUtf8(m_data + start, static_cast<int>(end - start)));
+}
+
+void XALargeFileView::paintEvent(QPaintEvent* /* event */)
+{
+    QPainter painter(viewport());
+    painter.fillRect(viewport()->rect(), palette().base());
+
+    auto height = rowHeight();
+    auto gutter = gutterWidth();
+    auto x = gutter + TextMargin - horizontalScrollBar()->value();
+    auto ascent = fontMetrics().ascent();
+
+    QColor mark_color = m_theme->getColorTheme() == "dark" ? QColor(0x264f78) : QColor(0xbbd5fd);
+    QColor selection_color = palette().highlight().color();
+
+    auto first = static_cast<int64_t>(verticalScrollBar()->value());
+    auto last = std::min(rowCount(), first + visibleRows() + 1);
+    int y = 0;
+    for (auto row = first; row < last; ++row, y += height)
+    {
+        auto text = rowText(row);
+        auto row_x = x + rowIndent(row);
+        fillSpan(painter, row, text, m_mark_start, m_mark_end, mark_color, row_x, y);
+        fillSpan(painter, row, text, selectionStart(), selectionEnd(), selection_color, row_x, y);
+
+        painter.setPen(palette().text().color());
+        drawText(painter, row_x, y + ascent, text);
+
+        if (hasFocus() && rowOf(m_cursor) == row)
+        {
+            auto cursor_x = row_x + textWidth(text, columnOf(row, m_cursor));
+            painter.drawLine(cursor_x, y, cursor_x, y + height - 1);
+        }
+    }
+
+    // line numbers stay in place when the text scrolls sideways
+    painter.fillRect(0, 0, gutter, viewport()->height(), Qt::lightGray);
+    painter.setPen(Qt::black);
+    y = 0;
+    for (auto row = first; row < last; ++row, y += height)
+    {
+        auto line = lineNumber(row);
+        if (line > 0)
+            painter.drawText(0, y, gutter - TextMargin, height, Qt::AlignRight, QString::number(line));
+    }
+}
+
+void XALargeFileView::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void XALargeFileView::changeEvent(QEvent* event)
+{
+    QAbstractScrollArea::changeEvent(event);
+    if (event->type() == QEvent::FontChange)
+        updateScrollBars();
+}
+
+void XALargeFileView::scrollContentsBy(int /* dx */, int /* dy */)
+{
+    // everything is painted from the scroll bar values
+    viewport()->update();
+}
+
+void XALargeFileView::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton)
+        return;
+
+    moveCursor(offsetAt(event->pos()), event->modifiers().testFlag(Qt::ShiftModifier));
+}
+
+void XALargeFileView::mouseMoveEvent(QMouseEvent* event)
+{
+    if (event->buttons().testFlag(Qt::LeftButton))
+        moveCursor(offsetAt(event->pos()), true);
+}
+
+void XALargeFileView::keyPressEvent(QKeyEvent* event)
+{
+    if (event->matches(QKeySequence::Copy))
+    {
+        copy();
+        return;
+    }
+    if (event->matches(QKeySequence::SelectAll))
+    {
+        moveCursor(0, false);
+        moveCursor(static_cast<int64_t>(m_size), true);
+        return;
+    }
+
+    bool keep_anchor = event->modifiers().testFlag(Qt::ShiftModifier);
+    auto row = rowOf(m_cursor);
+    auto column = columnOf(row, m_cursor);
+
+    switch (event->key())
+    {
+    case Qt::Key_Left:
+        moveCursor(previousOffset(m_cursor), keep_anchor);
+        break;
+    case Qt::Key_Right:
+        moveCursor(nextOffset(m_cursor), keep_anchor);
+        break;
+    case Qt::Key_Up:
+        if (row > 0)
+            moveCursor(offsetOf(row - 1, column), keep_anchor);
+        break;
+    case Qt::Key_Down:
+        if (row + 1 < rowCount())
+            moveCursor(offsetOf(row + 1, column), keep_anchor);
+        break;
+    case Qt::Key_PageUp:
+        moveCursor(offsetOf(std::max<int64_t>(0, row - visibleRows()), column), keep_anchor);
+        break;
+    case Qt::Key_PageDown:
+        moveCursor(offsetOf(std::min(rowCount() - 1, row + visibleRows()), column), keep_anchor);
+        break;
+    case Qt::Key_Home:
+        moveCursor(event->modifiers().testFlag(Qt::ControlModifier) ? 0 : rowStart(row), keep_anchor);
+        break;
+    case Qt::Key_End:
+        moveCursor(event->modifiers().testFlag(Qt::ControlModifier) ? static_cast<int64_t>(m_size) : rowEnd(row), keep_anchor);
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+        break;
+    }
+}
+
+int64_t XALargeFileView::lineNumber(int64_t row) const
+{
+    // line of the row counting from 1, 0 for a row that continues a broken line
+    return m_rows->lineNumber(row);
+}
+
+int XALargeFileView::rowIndent(int64_t row) const
+{
+    return m_rows->depth(row) * IndentWidth * fontMetrics().horizontalAdvance(QLatin1Char(' '));
+}
+
+int64_t XALargeFileView::rowCount() const
+{
+    return m_rows->rowCount();
+}
+
+int64_t XALargeFileView::rowOf(int64_t offset) const
+{
+    return m_rows->rowOf(offset);
+}
+
+int64_t XALargeFileView::rowStart(int64_t row) const
+{
+    return m_rows->rowStart(row);
+}
+
+int64_t XALargeFileView::rowEnd(int64_t row) const
+{
+    // the line break is not part of the row, neither is the CR of a CR LF,
+    // a row of a broken line ends where the next one starts
+    auto start = rowStart(row);
+    auto end = (row + 1 < rowCount()) ? rowStart(row + 1) : static_cast<int64_t>(m_size);
+    if (end > start && m_data[end - 1] == '\n' && row + 1 < rowCount())
+        --end;
+    if (end > start && m_data[end - 1] == '\r')
+        --end;
+    return end;
+}
+
+QString XALargeFileView::rowText(int64_t row) const
+{
+    auto start = rowStart(row);
+    return QString::fromUtf8(m_data + start, static_cast<int>(rowEnd(row) - start));
+}
+
+int XALargeFileView::columnOf(int64_t row, int64_t offset) const
+{
+    // UTF-16 units of the decoded row, four byte sequences take two
+    int column = 0;
+    auto end = std::min(offset, rowEnd(row));
+    for (auto pos = rowStart(row); pos < end; ++pos)
+    {
+        auto c = static_cast<unsigned char>(m_data[pos]);
+        if (!isContinuation(m_data[pos]))
+            column += (c >= 0xF0) ? 2 : 1;
+    }
+    return column;
+}
+
+int64_t XALargeFileView::offsetOf(int64_t row, int column) const
+{
+    auto offset = rowStart(row);
+    auto end = rowEnd(row);
+    int current = 0;
+    while (offset < end && current < column)
+    {
+        current += (static_cast<unsigned char>(m_data[offset]) >= 0xF0) ? 2 : 1;
+        ++offset;
+        while (offset < end && isContinuation(m_data[offset]))
+            ++offset;
+    }
+    return offset;
+}
+
+int64_t XALargeFileView::offsetAt(const QPoint& point) const
+{
+    int64_t row = verticalScrollBar()->value() + std::max(0, point.y()) / rowHeight();
+    row = std::min(row, rowCount() - 1);
+
+    auto x = point.x() - gutterWidth() - TextMargin - rowIndent(row) + horizontalScrollBar()->value();
+    return offsetOf(row, columnAt(rowText(row), x));
+}
+
+int64_t XALargeFileView::nextOffset(int64_t offset) const
+{
+    auto row = rowOf(offset);
+    if (offset >= rowEnd(row))
+        return (row + 1 < rowCount()) ? rowStart(row + 1) : offset;
+
+    ++offset;
+    while (offset < static_cast<int64_t>(m_size) && isContinuation(m_data[offset]))
+        ++offset;
+    return offset;
+}
+
+int64_t XALargeFileView::previousOffset(int64_t offset) const
+{
+    // a line break is passed at once, the rows of a broken line have none between them
+    auto row = rowOf(offset);
+    if (offset <= rowStart(row) && row > 0 && rowEnd(row - 1) < offset)
+        return rowEnd(row - 1);
+    if (offset <= 0)
+        return 0;
+
+    --offset;
+    while (offset > 0 && isContinuation(m_data[offset]))
+        --offset;
+    return offset;
+}
+
+int XALargeFileView::textWidth(const QString& text, int length) const
+{
+    auto metrics = fontMetrics();
+    auto tab = metrics.horizontalAdvance(QLatin1Char(' ')) * TabWidth;
+
+    int x = 0;
+    int segment = 0;
+    for (int i = 0; i < length; ++i)
+    {
+        if (text[i] == QLatin1Char('\t'))
+        {
+            x += metrics.horizontalAdvance(text.mid(segment, i - segment));
+            x = (x / tab + 1) * tab;
+            segment = i + 1;
+        }
+    }
+    return x + metrics.horizontalAdvance(text.mid(segment, length - segment));
+}
+
+int XALargeFileView::columnAt(const QString& text, int x) const
+{
+    // last column left of x, or the one behind it if that is closer
+    int first = 0;
+    int count = static_cast<int>(text.size());
+    while (count > 0)
+    {
+        int step = count / 2;
+        if (textWidth(text, first + step + 1) <= x)
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    if (first < text.size() && x - textWidth(text, first) > textWidth(text, first + 1) - x)
+        ++first;
+    return first;
+}
+
+void XALargeFileView::drawText(QPainter& painter, int x, int y, const QString& text) const
+{
+    int segment = 0;
+    for (int i = 0; i <= text.size(); ++i)
+    {
+        if (i == text.size() || text[i] == QLatin1Char('\t'))
+        {
+            painter.drawText(x + textWidth(text, segment), y, text.mid(segment, i - segment));
+            segment = i + 1;
+        }
+    }
+}
+
+void XALargeFileView::fillSpan(QPainter& painter, int64_t row, const QString& text, int64_t start, int64_t end,
+    const QColor& color, int x, int y) const
+{
+    auto row_start = rowStart(row);
+    auto row_end = rowEnd(row);
+    if (start < 0 || start >= end || end <= row_start || start > row_end)
+        return;
+
+    auto left = textWidth(text, columnOf(row, std::max(start, row_start)));
+    auto right = textWidth(text, columnOf(row, end));
+    // a span going on in the next row covers the line break as well
+    if (end > row_end)
+        right += fontMetrics().horizontalAdvance(QLatin1Char(' '));
+
+    painter.fillRect(x + left, y, right - left, rowHeight(), color);
+}
+
+int XALargeFileView::rowHeight() const
+{
+    return fontMetrics().lineSpacing();
+}
+
+int XALargeFileView::gutterWidth() const
+{
+    int digits = 1;
+    auto lines = m_rows->lineCount();
+    for (auto max = std::max<int64_t>(1, lines); max >= 10; max /= 10)
+        ++digits;
+
+    return TextMargin * 2 + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits;
+}
+
+int XALargeFileView::visibleRows() const
+{
+    return std::max(1, viewport()->height() / rowHeight());
+}
+
+void XALargeFileView::moveCursor(int64_t offset, bool keep_anchor)
+{
+    m_cursor = std::max<int64_t>(0, std::min<int64_t>(offset, m_size));
+    if (!keep_anchor)
+        m_anchor = m_cursor;
+
+    ensureVisible(m_cursor);
+    viewport()->update();
+    emit cursorPositionChanged();
+}
+
+void XALargeFileView::ensureVisible(int64_t offset)
+{
+    auto row = rowOf(offset);
+    auto first = static_cast<int64_t>(verticalScrollBar()->value());
+    if (row < first)
+        verticalScrollBar()->setValue(static_cast<int>(row));
+    else if (row >= first + visibleRows())
+        verticalScrollBar()->setValue(static_cast<int>(row - visibleRows() + 1));
+
+    auto x = rowIndent(row) + textWidth(rowText(row), columnOf(row, offset));
+    auto width = viewport()->width() - gutterWidth() - TextMargin * 2;
+    auto left = horizontalScrollBar()->value();
+    if (x < left)
+        horizontalScrollBar()->setValue(x);
+    else if (x > left + width)
+        horizontalScrollBar()->setValue(x - width);
+}
+
+void XALargeFileView::updateScrollBars()
+{
+    auto rows = visibleRows();
+    verticalScrollBar()->setRange(0, static_cast<int>(std::max<int64_t>(0, rowCount() - rows)));
+    verticalScrollBar()->setPageStep(rows);
+
+    // the widths of lines out of view are not measured, the longest row is estimated
+    auto width = viewport()->width() - gutterWidth() - TextMargin * 2;
+    auto text_width = std::min<int64_t>(m_rows->longestRow() * fontMetrics().averageCharWidth(), INT_MAX / 2);
+    horizontalScrollBar()->setRange(0, static_cast<int>(std::max<int64_t>(0, text_width - width)));
+    horizontalScrollBar()->setPageStep(std::max(1, width));
+}
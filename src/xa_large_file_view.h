@@ -0,0 +1,123 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <QAbstractScrollArea>
+#include <cstdint>
+#include <memory>
+#include "xa_row_index.h"
+#include "xa_xml_node_table.h"
+
+class QColor;
+class QPainter;
+class XAApp;
+class XATheme;
+
+
+/**
+ * Read-only text view for documents too large for the editor.
+ * Shows a UTF-8 buffer as it is, only the rows in view are decoded when painting.
+ * The rows come from an XARowIndex built with the document, broken lines are indented by nesting depth.
+ * Positions are byte offsets into the buffer, which is what the tree items of such a document hold.
+ */
+class XALargeFileView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    XALargeFileView(XAApp* app, QWidget* parent = nullptr);
+
+    /**
+     * Shows size bytes at data, they have to stay valid until the next call or clear
+     * rows has to be built over the same bytes, see XADocument::getRowIndex.
+     */
+    void setBuffer(const char* data, size_t size, std::shared_ptr<const XARowIndex> rows);
+    void clear();
+
+    int64_t cursorPosition() const;
+    int64_t selectionStart() const;
+    int64_t selectionEnd() const;
+
+    /**
+     * Highlights the text of a tree item and moves the cursor to it, see XAEditor::markSelectedRange
+     */
+    void markSelectedRange(XAXMLTreeItemType type, int64_t offset, int64_t end_offset);
+
+    /**
+     * Selects the text of a tree item, see XAEditor::selectRange
+     */
+    void selectRange(XAXMLTreeItemType type, int64_t offset, int64_t end_offset);
+
+    /**
+     * Copies the selection to the clipboard, a selection above MaxCopyLength bytes is refused with copyRefused
+     */
+    void copy();
+
+signals:
+    void cursorPositionChanged();
+    void copyRefused(qint64 length, qint64 max_length);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void changeEvent(QEvent* event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+
+private:
+    int64_t lineNumber(int64_t row) const;
+    int rowIndent(int64_t row) const;
+
+    int64_t rowCount() const;
+    int64_t rowOf(int64_t offset) const;
+    int64_t rowStart(int64_t row) const;
+    int64_t rowEnd(int64_t row) const;
+    QString rowText(int64_t row) const;
+
+    int columnOf(int64_t row, int64_t offset) const;
+    int64_t offsetOf(int64_t row, int column) const;
+    int64_t offsetAt(const QPoint& point) const;
+    int64_t nextOffset(int64_t offset) const;
+    int64_t previousOffset(int64_t offset) const;
+
+    int textWidth(const QString& text, int length) const;
+    int columnAt(const QString& text, int x) const;
+    void drawText(QPainter& painter, int x, int y, const QString& text) const;
+    void fillSpan(QPainter& painter, int64_t row, const QString& text, int64_t start, int64_t end,
+        const QColor& color, int x, int y) const;
+
+    int rowHeight() const;
+    int gutterWidth() const;
+    int visibleRows() const;
+    void moveCursor(int64_t offset, bool keep_anchor);
+    void ensureVisible(int64_t offset);
+    void updateScrollBars();
+
+private:
+    XATheme*                m_theme;
+    const char*             m_data;
+    size_t                  m_size;
+    std::shared_ptr<const XARowIndex> m_rows;
+    int64_t                 m_cursor;
+    int64_t                 m_anchor;
+    int64_t                 m_mark_start;
+    int64_t                 m_mark_end;
+};
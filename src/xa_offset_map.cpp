@@ -0,0 +1,192 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xa_offset_map.h"
+#include <algorithm>
+
+
+namespace
+{
+    // bytes between two checkpoints, bounds the walk of a lookup
+    const int64_t CheckpointDistance = 1024;
+
+    /**
+     * Advances over one character of the UTF-8 text, returns the number of UTF-16 units it takes
+     * A stray byte counts as one unit, as QString::fromUtf8 replaces it by one character.
+     */
+    inline int step(const char* data, int64_t size, int64_t& offset)
+    {
+        auto lead = static_cast<unsigned char>(data[offset]);
+        int length = (lead < 0xC0) ? 1 : (lead < 0xE0) ? 2 : (lead < 0xF0) ? 3 : 4;
+        offset = std::min(offset + length, size);
+        return (length == 4) ? 2 : 1;
+    }
+
+    inline bool isCrlfEnd(const char* data, int64_t offset)
+    {
+        return offset > 0 && data[offset] == '\n' && data[offset - 1] == '\r';
+    }
+}
+
+
+XAOffsetMap::XAOffsetMap()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_owner()
+    , m_checkpoints()
+    , m_identity(true)
+{
+}
+
+XAOffsetMap::XAOffsetMap(const char* data, size_t size, std::shared_ptr<const void> owner,
+    const XAScanProgress& progress)
+    : m_data(data)
+    , m_size(size)
+    , m_owner(std::move(owner))
+    , m_checkpoints()
+    , m_identity(true)
+{
+    const int64_t end = static_cast<int64_t>(size);
+
+    int64_t unit = 0;
+    int64_t crlf = 0;
+    int64_t next_checkpoint = 0;
+    int64_t next_report = XAScanProgressStep;
+    for (int64_t offset = 0; offset < end; )
+    {
+        if (offset >= next_checkpoint)
+        {
+            m_checkpoints.push_back({ offset, static_cast<int32_t>(unit), static_cast<int32_t>(crlf) });
+            next_checkpoint = offset + CheckpointDistance;
+
+            if (progress && offset >= next_report)
+            {
+                if (!progress(static_cast<size_t>(offset)))
+                    return;
+                next_report = offset + XAScanProgressStep;
+            }
+        }
+
+        if (isCrlfEnd(data, offset))
+            ++crlf;
+
+        unit += step(data, end, offset);
+    }
+    m_checkpoints.push_back({ end, static_cast<int32_t>(unit), static_cast<int32_t>(crlf) });
+
+    m_identity = unit == end && crlf == 0;
+}
+
+int64_t XAOffsetMap::toPosition(int64_t offset) const
+{
+    if (offset < 0 || m_identity)
+        return offset;
+
+    const auto& checkpoint = checkpointByOffset(offset);
+    const int64_t size = static_cast<int64_t>(m_size);
+
+    int64_t unit = checkpoint.unit;
+    int64_t crlf = checkpoint.crlf;
+    int64_t current = checkpoint.offset;
+    while (current < offset && current < size)
+    {
+        if (isCrlfEnd(m_data, current))
+            ++crlf;
+        unit += step(m_data, size, current);
+    }
+    return unit - crlf;
+}
+
+void XAOffsetMap::toPositions(std::vector<int64_t>& offsets) const
+{
+    if (m_identity)
+        return;
+
+    const int64_t size = static_cast<int64_t>(m_size);
+
+    int64_t unit = 0;
+    int64_t crlf = 0;
+    int64_t current = 0;
+    for (auto& offset : offsets)
+    {
+        if (offset < 0)
+            continue;
+
+        // a long way ahead, start from the checkpoint instead of walking there
+        if (offset - current > CheckpointDistance)
+        {
+            const auto& checkpoint = checkpointByOffset(offset);
+            if (checkpoint.offset > current)
+            {
+                unit = checkpoint.unit;
+                crlf = checkpoint.crlf;
+                current = checkpoint.offset;
+            }
+        }
+
+        while (current < offset && current < size)
+        {
+            if (isCrlfEnd(m_data, current))
+                ++crlf;
+            unit += step(m_data, size, current);
+        }
+        offset = unit - crlf;
+    }
+}
+
+int64_t XAOffsetMap::toOffset(int64_t position) const
+{
+    if (position < 0 || m_identity)
+        return position;
+
+    const auto& checkpoint = checkpointByPosition(position);
+    const int64_t size = static_cast<int64_t>(m_size);
+
+    int64_t unit = checkpoint.unit;
+    int64_t crlf = checkpoint.crlf;
+    int64_t offset = checkpoint.offset;
+    while (unit - crlf < position && offset < size)
+    {
+        if (isCrlfEnd(m_data, offset))
+            ++crlf;
+        unit += step(m_data, size, offset);
+    }
+    // the LF of a pair shares the position of its CR
+    if (offset < size && isCrlfEnd(m_data, offset))
+        offset += 1;
+    return offset;
+}
+
+bool XAOffsetMap::isIdentity() const
+{
+    return m_identity;
+}
+
+const XAOffsetMap::Checkpoint& XAOffsetMap::checkpointByOffset(int64_t offset) const
+{
+    auto it = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), offset,
+        [](int64_t value, const Checkpoint& checkpoint) { return value < checkpoint.offset; });
+    return *(it - 1);
+}
+
+const XAOffsetMap::Checkpoint& XAOffsetMap::checkpointByPosition(int64_t position) const
+{
+    auto it = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), position,
+        [](int64_t value, const Checkpoint& checkpoint) { return value < checkpoint.unit - checkpoint.crlf; });
+    return *(it - 1);
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "xa_scan_progress.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+/**
+ * Converts byte offsets into the UTF-8 source of a document to editor positions and back.
+ * Editor positions count UTF-16 units, with a CR LF pair counting once like in QTextDocument.
+ * Checkpoints every few hundred bytes keep the map small, a lookup is a binary search
+ * followed by a short walk over the text.
+ */
+class XAOffsetMap
+{
+public:
+    /**
+     * Maps every offset to itself
+     */
+    XAOffsetMap();
+
+    /**
+     * Indexes size bytes of UTF-8 text at data
+     * The bytes are walked on every lookup, owner keeps them alive, without one they have to outlive the map.
+     * The map is incomplete when progress stopped it.
+     */
+    XAOffsetMap(const char* data, size_t size, std::shared_ptr<const void> owner = nullptr,
+        const XAScanProgress& progress = XAScanProgress());
+
+    /**
+     * Editor position of a byte offset, -1 stays -1
+     */
+    int64_t toPosition(int64_t offset) const;
+
+    /**
+     * Editor positions of ascending byte offsets, translated in place by a single walk over the text
+     */
+    void toPositions(std::vector<int64_t>& offsets) const;
+
+    /**
+     * Byte offset of an editor position, -1 stays -1
+     */
+    int64_t toOffset(int64_t position) const;
+
+    /**
+     * Whether bytes and positions are the same, as for ASCII text without CR LF
+     */
+    bool isIdentity() const;
+
+private:
+    struct Checkpoint
+    {
+        int64_t offset;
+        int32_t unit;
+        int32_t crlf;
+    };
+
+    const Checkpoint& checkpointByOffset(int64_t offset) const;
+    const Checkpoint& checkpointByPosition(int64_t position) const;
+
+private:
+    const char*             m_data;
+    size_t                  m_size;
+    std::shared_ptr<const void> m_owner;
+    std::vector<Checkpoint> m_checkpoints;
+    bool                    m_identity;
+};
@@ -0,0 +1,233 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "xa_piece_table.h"
+#include "xa_offset_map.h"
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+    // inserted text is collected in blocks of this size, a block is never moved
+    const size_t BlockSize = 64 * 1024;
+}
+
+
+XAPieceTable::XAPieceTable()
+    : m_source(nullptr)
+    , m_source_size(0)
+    , m_owner()
+    , m_offsets(std::make_shared<XAOffsetMap>())
+    , m_blocks()
+    , m_block_used(0)
+    , m_pieces()
+    , m_starts()
+    , m_valid_starts(0)
+    , m_size(0)
+    , m_length(0)
+{
+}
+
+XAPieceTable::XAPieceTable(const char* data, size_t size, std::shared_ptr<const void> owner,
+    std::shared_ptr<const XAOffsetMap> offsets)
+    : m_source(data)
+    , m_source_size(size)
+    , m_owner(std::move(owner))
+    , m_offsets(std::move(offsets))
+    , m_blocks()
+    , m_block_used(0)
+    , m_pieces()
+    , m_starts()
+    , m_valid_starts(0)
+    , m_size(size)
+    , m_length(m_offsets->toPosition(static_cast<int64_t>(size)))
+{
+    if (size > 0)
+    {
+        m_pieces.push_back({ data, size, m_length, true });
+        m_starts.push_back(0);
+    }
+}
+
+size_t XAPieceTable::size() const
+{
+    return m_size;
+}
+
+int64_t XAPieceTable::length() const
+{
+    return m_length;
+}
+
+size_t XAPieceTable::pieceCount() const
+{
+    return m_pieces.size();
+}
+
+bool XAPieceTable::isSource() const
+{
+    return m_pieces.size() == 1 && m_pieces[0].source && m_pieces[0].data == m_source
+        && m_pieces[0].size == m_source_size;
+}
+
+const char* XAPieceTable::source() const
+{
+    return m_source;
+}
+
+std::shared_ptr<const void> XAPieceTable::owner() const
+{
+    return m_owner;
+}
+
+std::shared_ptr<const XAOffsetMap> XAPieceTable::offsetMap() const
+{
+    return m_offsets;
+}
+
+void XAPieceTable::replace(int64_t position, int64_t removed, const QString& text)
+{
+    position = std::max<int64_t>(0, std::min(position, m_length));
+    removed = std::max<int64_t>(0, std::min(removed, m_length - position));
+
+    auto first = split(position);
+    auto last = split(position + removed);
+    for (auto i = first; i < last; ++i)
+    {
+        m_size -= m_pieces[i].size;
+        m_length -= m_pieces[i].length;
+    }
+    m_pieces.erase(m_pieces.begin() + first, m_pieces.begin() + last);
+    invalidateStarts(first);
+
+    if (text.isEmpty())
+        return;
+
+    auto utf8 = text.toUtf8();
+    auto size = static_cast<size_t>(utf8.size());
+    bool extends = false;
+    auto data = append(utf8.constData(), size, extends);
+
+    // typing adds to the piece written last instead of adding a piece per keystroke
+    if (extends && first > 0 && !m_pieces[first - 1].source && m_pieces[first - 1].data + m_pieces[first - 1].size == data)
+    {
+        m_pieces[first - 1].size += size;
+        m_pieces[first - 1].length += text.size();
+    }
+    else
+    {
+        m_pieces.insert(m_pieces.begin() + first, { data, size, text.size(), false });
+        invalidateStarts(first);
+    }
+    m_size += size;
+    m_length += text.size();
+}
+
+void XAPieceTable::read(char* out) const
+{
+    for (const auto& piece : m_pieces)
+    {
+        memcpy(out, piece.data, piece.size);
+        out += piece.size;
+    }
+}
+
+size_t XAPieceTable::split(int64_t position)
+{
+    auto i = findPiece(position);
+    if (i == m_pieces.size() || position == m_starts[i])
+        return i;
+
+    auto piece = m_pieces[i];
+    position -= m_starts[i];
+    auto bytes = byteOffset(piece, position);
+    m_pieces[i] = { piece.data, bytes, position, piece.source };
+    m_pieces.insert(m_pieces.begin() + i + 1,
+        { piece.data + bytes, piece.size - bytes, piece.length - position, piece.source });
+    invalidateStarts(i + 1);
+    return i + 1;
+}
+
+size_t XAPieceTable::findPiece(int64_t position)
+{
+    // the start positions are summed up lazily behind the last edit, edits close to each other,
+    // like typing, only extend them by a few pieces and the piece itself is a binary search
+    while (m_valid_starts < m_pieces.size() &&
+        (m_valid_starts == 0 || m_starts[m_valid_starts - 1] + m_pieces[m_valid_starts - 1].length <= position))
+    {
+        m_starts[m_valid_starts] = (m_valid_starts == 0) ? 0 :
+            m_starts[m_valid_starts - 1] + m_pieces[m_valid_starts - 1].length;
+        ++m_valid_starts;
+    }
+
+    // the piece holding position, or the end if it is behind the last one
+    auto first = m_starts.begin();
+    auto last = first + m_valid_starts;
+    auto i = static_cast<size_t>(std::upper_bound(first, last, position) - first);
+    if (i == 0)
+        return m_pieces.size();
+    --i;
+    return (m_starts[i] + m_pieces[i].length > position) ? i : m_pieces.size();
+}
+
+void XAPieceTable::invalidateStarts(size_t first)
+{
+    m_starts.resize(m_pieces.size());
+    m_valid_starts = std::min(m_valid_starts, first);
+}
+
+size_t XAPieceTable::byteOffset(const Piece& piece, int64_t position) const
+{
+    // the source can be large, its map knows where a position is
+    if (piece.source)
+    {
+        auto start = piece.data - m_source;
+        return static_cast<size_t>(m_offsets->toOffset(m_offsets->toPosition(start) + position) - start);
+    }
+
+    // inserted text is short and comes from the editor, which has no CR LF
+    size_t offset = 0;
+    while (position > 0 && offset < piece.size)
+    {
+        auto lead = static_cast<unsigned char>(piece.data[offset]);
+        position -= (lead >= 0xF0) ? 2 : 1;
+        ++offset;
+        while (offset < piece.size && (static_cast<unsigned char>(piece.data[offset]) & 0xC0) == 0x80)
+            ++offset;
+    }
+    return offset;
+}
+
+const char* XAPieceTable::append(const char* data, size_t size, bool& extends)
+{
+    // a block shared with a snapshot is not written to anymore, the snapshot may be read meanwhile
+    extends = !m_blocks.empty() && m_blocks.back().use_count() == 1 && m_block_used + size <= BlockSize;
+    if (!extends)
+    {
+        auto capacity = std::max(size, BlockSize);
+        m_blocks.push_back(std::shared_ptr<char>(new char[capacity], std::default_delete<char[]>()));
+        m_block_used = 0;
+    }
+
+    auto target = m_blocks.back().get() + m_block_used;
+    memcpy(target, data, size);
+    m_block_used += size;
+    return target;
+}
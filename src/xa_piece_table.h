@@ -0,0 +1,109 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class XAOffsetMap;
+
+
+/**
+ * UTF-8 text of the editor as a piece table.
+ * The text starts as one piece referring to the source of the document, which is never written to.
+ * Edits only add small pieces for the inserted text and split or drop the ones they touch.
+ * Positions are editor positions as translated by XAOffsetMap, the pieces keep the bytes.
+ *
+ * Copies share the pieces, so a copy is a cheap snapshot that can be read on another thread
+ * while the original is edited further.
+ */
+class XAPieceTable
+{
+public:
+    XAPieceTable();
+
+    /**
+     * Starts with size bytes at data as the only piece, owner keeps them alive
+     * offsets translates the positions of exactly these bytes.
+     */
+    XAPieceTable(const char* data, size_t size, std::shared_ptr<const void> owner,
+        std::shared_ptr<const XAOffsetMap> offsets);
+
+    /**
+     * Size of the text in bytes
+     */
+    size_t size() const;
+
+    /**
+     * Size of the text in editor positions
+     */
+    int64_t length() const;
+
+    size_t pieceCount() const;
+
+    /**
+     * Whether the text is still the whole source as the table started with
+     * Then source(), owner() and offsetMap() describe it and nothing has to be copied.
+     */
+    bool isSource() const;
+    const char* source() const;
+    std::shared_ptr<const void> owner() const;
+    std::shared_ptr<const XAOffsetMap> offsetMap() const;
+
+    /**
+     * Replaces removed editor positions at position by text
+     */
+    void replace(int64_t position, int64_t removed, const QString& text);
+
+    /**
+     * Copies the text to out, which has room for size() bytes
+     */
+    void read(char* out) const;
+
+private:
+    struct Piece
+    {
+        const char* data;
+        size_t      size;
+        int64_t     length;
+        bool        source;
+    };
+
+    size_t split(int64_t position);
+    size_t findPiece(int64_t position);
+    void invalidateStarts(size_t first);
+    size_t byteOffset(const Piece& piece, int64_t position) const;
+    const char* append(const char* data, size_t size, bool& extends);
+
+private:
+    const char*                         m_source;
+    size_t                              m_source_size;
+    std::shared_ptr<const void>         m_owner;
+    std::shared_ptr<const XAOffsetMap>  m_offsets;
+    std::vector<std::shared_ptr<char>>  m_blocks;
+    size_t                              m_block_used;
+    std::vector<Piece>                  m_pieces;
+    std::vector<int64_t>                m_starts;
+    size_t                              m_valid_starts;
+    size_t                              m_size;
+    int64_t                             m_length;
+};
@@ -0,0 +1,237 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+
+#include "xa_row_index.h"
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+    // lines longer than this are broken into rows, so is text between two tags
+    const int64_t MaxRowLength = 4096;
+
+    inline bool isContinuation(char c)
+    {
+        return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+    }
+
+    /**
+     * Offset behind the first occurrence of pattern at or behind pos, end if there is none
+     */
+    int64_t skipPast(const char* data, int64_t end, int64_t pos, const char* pattern)
+    {
+        auto length = static_cast<int64_t>(strlen(pattern));
+        while (pos + length <= end)
+        {
+            auto hit = static_cast<const char*>(memchr(data + pos, pattern[0], end - pos - length + 1));
+            if (!hit)
+                break;
+            pos = hit - data;
+            if (memcmp(hit, pattern, length) == 0)
+                return pos + length;
+            ++pos;
+        }
+        return end;
+    }
+
+    inline bool startsWith(const char* data, int64_t end, int64_t pos, const char* prefix)
+    {
+        auto length = static_cast<int64_t>(strlen(prefix));
+        return pos + length <= end && memcmp(data + pos, prefix, length) == 0;
+    }
+}
+
+
+XARowIndex::XARowIndex()
+    : m_row_starts(1, 0)
+    , m_line_rows()
+    , m_row_depths()
+    , m_longest_row(0)
+{
+}
+
+XARowIndex::XARowIndex(const char* data, size_t size, const XAScanProgress& progress)
+    : m_row_starts()
+    , m_line_rows()
+    , m_row_depths()
+    , m_longest_row(0)
+{
+    // one pass for the row starts, everything else is decoded by the view when it comes into view
+    int64_t pos = 0;
+    int64_t next_report = XAScanProgressStep;
+    const int64_t end_of_data = static_cast<int64_t>(size);
+    while (true)
+    {
+        auto hit = (pos < end_of_data) ? static_cast<const char*>(memchr(data + pos, '\n', end_of_data - pos)) : nullptr;
+        auto end = hit ? hit - data : end_of_data;
+
+        m_line_rows.push_back(rowCount());
+        if (end - pos > MaxRowLength)
+        {
+            splitLine(data, pos, end);
+        }
+        else
+        {
+            addRow(pos, 0);
+            m_longest_row = std::max(m_longest_row, end - pos);
+        }
+
+        if (!hit)
+            break;
+        pos = end + 1;
+
+        if (progress && pos >= next_report)
+        {
+            if (!progress(static_cast<size_t>(pos)))
+                break;
+            next_report = pos + XAScanProgressStep;
+        }
+    }
+
+    // without broken lines rows are lines, no need to keep where lines start
+    if (m_line_rows.size() == m_row_starts.size())
+        m_line_rows = std::vector<int64_t>();
+    if (!m_row_depths.empty())
+        m_row_depths.resize(m_row_starts.size(), 0);
+}
+
+int64_t XARowIndex::rowCount() const
+{
+    return static_cast<int64_t>(m_row_starts.size());
+}
+
+int64_t XARowIndex::rowOf(int64_t offset) const
+{
+    auto it = std::upper_bound(m_row_starts.begin(), m_row_starts.end(), offset);
+    return std::max<int64_t>(0, (it - m_row_starts.begin()) - 1);
+}
+
+int64_t XARowIndex::rowStart(int64_t row) const
+{
+    return m_row_starts[row];
+}
+
+int64_t XARowIndex::lineNumber(int64_t row) const
+{
+    if (m_line_rows.empty())
+        return row + 1;
+
+    auto it = std::upper_bound(m_line_rows.begin(), m_line_rows.end(), row);
+    auto line = it - m_line_rows.begin();
+    return (*(it - 1) == row) ? line : 0;
+}
+
+int64_t XARowIndex::lineCount() const
+{
+    return m_line_rows.empty() ? rowCount() : static_cast<int64_t>(m_line_rows.size());
+}
+
+int XARowIndex::depth(int64_t row) const
+{
+    return m_row_depths.empty() ? 0 : m_row_depths[row];
+}
+
+int64_t XARowIndex::longestRow() const
+{
+    return m_longest_row;
+}
+
+void XARowIndex::addRow(int64_t start, int depth)
+{
+    m_row_starts.push_back(start);
+
+    // depths are only kept once a line was broken, rows before it are not indented
+    if (depth > 0 || !m_row_depths.empty())
+    {
+        m_row_depths.resize(m_row_starts.size() - 1, 0);
+        m_row_depths.push_back(static_cast<uint16_t>(std::min(depth, 0xFFFF)));
+    }
+}
+
+void XARowIndex::splitLine(const char* data, int64_t start, int64_t end)
+{
+    // a row per tag where one tag directly follows another, which is how a minified document looks
+    // pretty printed, the depth is counted from the tags of this line only
+    int depth = 0;
+    int row_depth = 0;
+    int64_t row_start = start;
+    int64_t pos = start;
+    while (pos < end)
+    {
+        auto hit = static_cast<const char*>(memchr(data + pos, '<', end - pos));
+        if (!hit)
+            break;
+        auto lt = hit - data;
+
+        int tag_depth = depth;
+        if (startsWith(data, end, lt, "<!--"))
+        {
+            pos = skipPast(data, end, lt + 4, "-->");
+        }
+        else if (startsWith(data, end, lt, "<![CDATA["))
+        {
+            pos = skipPast(data, end, lt + 9, "]]>");
+        }
+        else if (startsWith(data, end, lt, "<?") || startsWith(data, end, lt, "<!"))
+        {
+            pos = skipPast(data, end, lt + 2, ">");
+        }
+        else if (startsWith(data, end, lt, "</"))
+        {
+            depth = std::max(0, depth - 1);
+            tag_depth = depth;
+            pos = skipPast(data, end, lt + 2, ">");
+        }
+        else
+        {
+            pos = skipPast(data, end, lt + 1, ">");
+            if (data[pos - 1] == '>' && data[pos - 2] != '/')
+                ++depth;
+        }
+
+        if (lt > row_start && data[lt - 1] == '>')
+        {
+            chunkRow(data, row_start, lt, row_depth);
+            row_start = lt;
+            row_depth = tag_depth;
+        }
+    }
+    chunkRow(data, row_start, end, row_depth);
+}
+
+void XARowIndex::chunkRow(const char* data, int64_t start, int64_t end, int depth)
+{
+    // long text between tags is cut into rows of a fixed length, at a character boundary
+    addRow(start, depth);
+    auto row_start = start;
+    while (end - row_start > MaxRowLength)
+    {
+        auto cut = row_start + MaxRowLength;
+        while (cut < end && isContinuation(data[cut]))
+            ++cut;
+        if (cut >= end)
+            break;
+        m_longest_row = std::max(m_longest_row, cut - row_start);
+        addRow(cut, depth);
+        row_start = cut;
+    }
+    m_longest_row = std::max(m_longest_row, end - row_start);
+}
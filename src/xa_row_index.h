@@ -0,0 +1,81 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "xa_scan_progress.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * Where the rows of XALargeFileView start in its buffer, built in one pass over the whole buffer.
+ * Lines too long to lay out, as in minified files, are broken into rows between tags
+ * and given the nesting depth of their tags, the buffer itself stays untouched.
+ * Building it takes a pass over a file of many GB, so it is done by the loader and not by the view.
+ */
+class XARowIndex
+{
+public:
+    /**
+     * No rows, as for an empty buffer
+     */
+    XARowIndex();
+
+    /**
+     * Indexes size bytes at data, the bytes are only read while the index is built
+     * The index is incomplete when progress stopped it.
+     */
+    XARowIndex(const char* data, size_t size, const XAScanProgress& progress = XAScanProgress());
+
+    int64_t rowCount() const;
+
+    /**
+     * Row holding the byte at offset
+     */
+    int64_t rowOf(int64_t offset) const;
+    int64_t rowStart(int64_t row) const;
+
+    /**
+     * Line of the row counting from 1, 0 for a row that continues a broken line
+     */
+    int64_t lineNumber(int64_t row) const;
+    int64_t lineCount() const;
+
+    /**
+     * Nesting depth of a row of a broken line, 0 for the rows of other lines
+     */
+    int depth(int64_t row) const;
+
+    /**
+     * Length of the longest row in bytes
+     */
+    int64_t longestRow() const;
+
+private:
+    void addRow(int64_t start, int depth);
+    void splitLine(const char* data, int64_t start, int64_t end);
+    void chunkRow(const char* data, int64_t start, int64_t end, int depth);
+
+private:
+    std::vector<int64_t>    m_row_starts;
+    std::vector<int64_t>    m_line_rows;
+    std::vector<uint16_t>   m_row_depths;
+    int64_t                 m_longest_row;
+};
@@ -0,0 +1,31 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+
+/**
+ * Called by the scans over a document buffer with the number of bytes done, about every XAScanProgressStep bytes
+ * Returning false stops the scan, what it found so far is incomplete and has to be dropped.
+ */
+using XAScanProgress = std::function<bool(size_t done)>;
+
+const size_t XAScanProgressStep = 4 * 1024 * 1024;
@@ -0,0 +1,300 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xa_span_index.h"
+#include "xa_token_stream.h"
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+    /**
+     * Offset of the first occurrence of pattern at or behind pos, size if there is none
+     */
+    size_t find(const char* data, size_t size, size_t pos, const char* pattern)
+    {
+        auto length = strlen(pattern);
+        while (pos + length <= size)
+        {
+            auto hit = static_cast<const char*>(memchr(data + pos, pattern[0], size - pos - length + 1));
+            if (!hit)
+                break;
+            pos = hit - data;
+            if (memcmp(hit, pattern, length) == 0)
+                return pos;
+            ++pos;
+        }
+        return size;
+    }
+
+    inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    bool startsWith(const char* data, size_t size, size_t pos, const char* prefix)
+    {
+        auto length = strlen(prefix);
+        return pos + length <= size && memcmp(data + pos, prefix, length) == 0;
+    }
+
+    /**
+     * Offset of the '>' closing the markup that starts at pos, quoted parts are skipped
+     * Brackets nest for the internal subset of a DOCTYPE.
+     */
+    size_t findTagEnd(const char* data, size_t size, size_t pos)
+    {
+        int brackets = 0;
+        for (; pos < size; ++pos)
+        {
+            switch (data[pos])
+            {
+            case '"':
+            case '\'':
+            {
+                auto quote = memchr(data + pos + 1, data[pos], size - pos - 1);
+                if (!quote)
+                    return size;
+                pos = static_cast<const char*>(quote) - data;
+            } break;
+            case '[': ++brackets; break;
+            case ']': --brackets; break;
+            case '>':
+                if (brackets <= 0)
+                    return pos;
+                break;
+            default:
+                break;
+            }
+        }
+        return size;
+    }
+
+    /**
+     * Adds the tokens of the processing instruction at pos, returns the offset of its closing "?>"
+     * Pseudo attributes as in the XML declaration are told apart from plain content.
+     */
+    size_t scanInstruction(const char* data, size_t size, size_t pos, XATokenStream* tokens)
+    {
+        auto end = find(data, size, pos + 2, "?>");
+        if (!tokens)
+            return end;
+
+        tokens->add(pos, pos + 2, XATokenStream::ELEMENT);
+        auto i = pos + 2;
+        while (i < end && !isSpace(data[i]))
+            ++i;
+        tokens->add(pos + 2, i, XATokenStream::PI_TARGET);
+
+        while (i < end)
+        {
+            if (isSpace(data[i]) || data[i] == '=')
+            {
+                ++i;
+            }
+            else if (data[i] == '"' || data[i] == '\'')
+            {
+                auto quote = memchr(data + i + 1, data[i], end - i - 1);
+                auto stop = quote ? static_cast<size_t>(static_cast<const char*>(quote) - data) + 1 : end;
+                tokens->add(i, stop, XATokenStream::ATTRIBUTE_VALUE);
+                i = stop;
+            }
+            else
+            {
+                auto word = i;
+                while (i < end && !isSpace(data[i]) && data[i] != '=' && data[i] != '"' && data[i] != '\'')
+                    ++i;
+                auto next = i;
+                while (next < end && isSpace(data[next]))
+                    ++next;
+                tokens->add(word, i, (next < end && data[next] == '=') ? XATokenStream::ATTRIBUTE : XATokenStream::PI_VALUE);
+            }
+        }
+
+        if (end < size)
+            tokens->add(end, end + 2, XATokenStream::ELEMENT);
+        return end;
+    }
+}
+
+
+XASpanIndex::XASpanIndex()
+    : m_elements()
+    , m_attributes()
+{
+}
+
+XASpanIndex::XASpanIndex(const char* data, size_t size, XATokenStream* tokens, const XAScanProgress& progress)
+    : m_elements()
+    , m_attributes()
+{
+    // indices of the elements whose end tag is still to come
+    std::vector<size_t> open;
+
+    size_t pos = 0;
+    size_t next_report = XAScanProgressStep;
+    while (pos < size)
+    {
+        if (progress && pos >= next_report)
+        {
+            if (!progress(pos))
+                return;
+            next_report = pos + XAScanProgressStep;
+        }
+
+        auto hit = static_cast<const char*>(memchr(data + pos, '<', size - pos));
+        if (!hit)
+            break;
+        pos = hit - data;
+
+        if (startsWith(data, size, pos, "<!--"))
+        {
+            auto end = std::min(find(data, size, pos + 4, "-->") + 3, size);
+            if (tokens)
+                tokens->add(pos, end, XATokenStream::COMMENT);
+            pos = end;
+        }
+        else if (startsWith(data, size, pos, "<![CDATA["))
+        {
+            auto end = std::min(find(data, size, pos + 9, "]]>") + 3, size);
+            if (tokens)
+                tokens->add(pos, end, XATokenStream::CDATA);
+            pos = end;
+        }
+        else if (startsWith(data, size, pos, "<?"))
+        {
+            pos = scanInstruction(data, size, pos, tokens) + 2;
+        }
+        else if (startsWith(data, size, pos, "<!"))
+        {
+            pos = findTagEnd(data, size, pos + 2) + 1;
+        }
+        else if (startsWith(data, size, pos, "</"))
+        {
+            auto end = find(data, size, pos + 2, ">") + 1;
+            if (tokens)
+                tokens->add(pos, std::min(end, size), XATokenStream::ELEMENT);
+            if (!open.empty())
+            {
+                m_elements[open.back()].end = static_cast<int64_t>(std::min(end, size));
+                open.pop_back();
+            }
+            pos = end;
+        }
+        else
+        {
+            auto end = scanStartTag(data, size, pos, tokens);
+            if (end < size && data[end - 1] == '/')
+                m_elements.back().end = static_cast<int64_t>(end + 1);
+            else
+                open.push_back(m_elements.size() - 1);
+            pos = end + 1;
+        }
+    }
+}
+
+int64_t XASpanIndex::elementEnd(int64_t name_offset) const
+{
+    auto it = std::lower_bound(m_elements.begin(), m_elements.end(), name_offset,
+        [](const Element& element, int64_t value) { return element.name < value; });
+    if (it == m_elements.end() || it->name != name_offset)
+        return -1;
+    return it->end;
+}
+
+std::vector<XASpanIndex::Span> XASpanIndex::attributeSpans(int64_t name_offset) const
+{
+    std::vector<Span> spans;
+
+    auto it = std::lower_bound(m_elements.begin(), m_elements.end(), name_offset,
+        [](const Element& element, int64_t value) { return element.name < value; });
+    if (it == m_elements.end() || it->name != name_offset)
+        return spans;
+
+    auto first = static_cast<size_t>(it->first_attribute);
+    auto last = (it + 1 == m_elements.end()) ? m_attributes.size() : static_cast<size_t>((it + 1)->first_attribute);
+    for (auto i = first; i < last; ++i)
+    {
+        spans.push_back({ m_attributes[i].name, m_attributes[i].end });
+    }
+    return spans;
+}
+
+size_t XASpanIndex::memoryUsage() const
+{
+    return m_elements.capacity() * sizeof(Element)
+        + m_attributes.capacity() * sizeof(Attribute);
+}
+
+size_t XASpanIndex::scanStartTag(const char* data, size_t size, size_t pos, XATokenStream* tokens)
+{
+    m_elements.push_back({ static_cast<int64_t>(pos + 1), -1, static_cast<int64_t>(m_attributes.size()) });
+
+    // element name
+    auto i = pos + 1;
+    while (i < size && !isSpace(data[i]) && data[i] != '/' && data[i] != '>')
+        ++i;
+    if (tokens)
+        tokens->add(pos, i, XATokenStream::ELEMENT);
+
+    // name = "value" pairs, anything malformed is left to the search for the end of the tag
+    while (i < size)
+    {
+        while (i < size && isSpace(data[i]))
+            ++i;
+        if (i >= size || data[i] == '/' || data[i] == '>')
+            break;
+
+        auto name = i;
+        while (i < size && !isSpace(data[i]) && data[i] != '=' && data[i] != '/' && data[i] != '>')
+            ++i;
+        if (tokens)
+            tokens->add(name, i, XATokenStream::ATTRIBUTE);
+        while (i < size && isSpace(data[i]))
+            ++i;
+        if (i >= size || data[i] != '=')
+            break;
+        ++i;
+        while (i < size && isSpace(data[i]))
+            ++i;
+        if (i >= size || (data[i] != '"' && data[i] != '\''))
+            break;
+
+        auto value = i;
+        auto quote = memchr(data + i + 1, data[i], size - i - 1);
+        if (!quote)
+        {
+            if (tokens)
+                tokens->add(value, size, XATokenStream::ATTRIBUTE_VALUE);
+            return size;
+        }
+        i = static_cast<const char*>(quote) - data + 1;
+        m_attributes.push_back({ static_cast<int64_t>(name), static_cast<int64_t>(i) });
+        if (tokens)
+            tokens->add(value, i, XATokenStream::ATTRIBUTE_VALUE);
+    }
+
+    auto end = findTagEnd(data, size, i);
+    if (tokens && end < size)
+    {
+        auto empty = end > pos && data[end - 1] == '/';
+        tokens->add(empty ? end - 1 : end, end + 1, XATokenStream::ELEMENT);
+    }
+    return end;
+}
@@ -0,0 +1,90 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "xa_scan_progress.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class XATokenStream;
+
+
+/**
+ * Source spans of the elements and attributes of a document, found by a structural scan of its UTF-8 buffer.
+ * pugixml keeps no end offsets, so the scan runs over the source before it is parsed.
+ * Elements are stored in document order and looked up by the offset of their name,
+ * which is what pugi::xml_node::offset_debug reports.
+ */
+class XASpanIndex
+{
+public:
+    struct Span
+    {
+        int64_t offset;
+        int64_t end;
+    };
+
+    XASpanIndex();
+
+    /**
+     * Scans size bytes at data, the markup tokens met on the way are added to tokens if given
+     * The index is incomplete when progress stopped the scan.
+     */
+    XASpanIndex(const char* data, size_t size, XATokenStream* tokens = nullptr,
+        const XAScanProgress& progress = XAScanProgress());
+
+    /**
+     * Byte offset behind the end tag of the element whose name starts at name_offset,
+     * -1 if the element is unknown or not closed
+     */
+    int64_t elementEnd(int64_t name_offset) const;
+
+    /**
+     * Spans of the attributes of the element whose name starts at name_offset in document order,
+     * each from the attribute name to behind the closing quote of its value
+     */
+    std::vector<Span> attributeSpans(int64_t name_offset) const;
+
+    /**
+     * Bytes held by the index
+     */
+    size_t memoryUsage() const;
+
+private:
+    size_t scanStartTag(const char* data, size_t size, size_t pos, XATokenStream* tokens);
+
+private:
+    // offsets are 64 bit, a mapped file can be larger than 2 GB
+    struct Element
+    {
+        int64_t name;
+        int64_t end;
+        int64_t first_attribute;
+    };
+
+    struct Attribute
+    {
+        int64_t name;
+        int64_t end;
+    };
+
+    std::vector<Element>    m_elements;
+    std::vector<Attribute>  m_attributes;
+};
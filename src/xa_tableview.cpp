@@ -16,6 +16,7 @@
  */
 
 #include "xa_tableview.h"
+#include "xa_byte_scan.h"
 #include <QDebug>
 #include <QHeaderView>
 #include <QLabel>
@@ -24,6 +25,31 @@
 #include <QTableWidget>
 #include <QVBoxLayout>
 #include <algorithm>
+#include <cstring>
+#include <string>
+
+
+namespace
+{
+    /**
+     * The text with its line breaks dropped, cleaned on the UTF-8 bytes before they are decoded
+     */
+    QString withoutLineBreaks(const char* text)
+    {
+        static const XAByteScan line_breaks("\r\n");
+        auto size = strlen(text);
+        std::string kept;
+        kept.reserve(size);
+        size_t pos = 0;
+        while (pos < size)
+        {
+            auto hit = line_breaks.find(text, size, pos);
+            kept.append(text + pos, hit - pos);
+            pos = hit + 1;
+        }
+        return QString::fromUtf8(kept.data(), static_cast<int>(kept.size()));
+    }
+}
 
 
 XATableView::XATableView(QWidget* parent)
@@ -494,9 +520,7 @@ QString XATableView::getCellContent(const pugi::xml_node& node, int occurrence)
 void XATableView::addTextRow(QTableWidget* table, QStringList& headers, const pugi::xml_node& node, int row)
 {
     QString childName = "Text";
-    QString childValue = node.text().as_string();
-    childValue.remove('\n');
-    childValue.remove('\r');
+    QString childValue = withoutLineBreaks(node.text().as_string());
     QFontMetrics metrics(table->font());
 
     if (row == 0)
@@ -0,0 +1,85 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xa_token_stream.h"
+#include "xa_offset_map.h"
+#include <algorithm>
+
+
+XATokenStream::XATokenStream()
+    : m_tokens()
+{
+}
+
+void XATokenStream::add(size_t start, size_t end, Kind kind)
+{
+    if (end > start)
+        m_tokens.push_back({ static_cast<int32_t>(start), static_cast<int32_t>(end - start), kind });
+}
+
+void XATokenStream::translate(const XAOffsetMap& offsets)
+{
+    if (offsets.isIdentity())
+        return;
+
+    // starts and ends of disjoint tokens in text order ascend, so one walk translates them all
+    std::vector<int64_t> bounds;
+    bounds.reserve(m_tokens.size() * 2);
+    for (const auto& token : m_tokens)
+    {
+        bounds.push_back(token.start);
+        bounds.push_back(static_cast<int64_t>(token.start) + token.length);
+    }
+
+    offsets.toPositions(bounds);
+
+    for (size_t i = 0; i < m_tokens.size(); ++i)
+    {
+        m_tokens[i].start = static_cast<int32_t>(bounds[2 * i]);
+        m_tokens[i].length = static_cast<int32_t>(bounds[2 * i + 1] - bounds[2 * i]);
+    }
+}
+
+XATokenStream::const_iterator XATokenStream::find(int64_t position) const
+{
+    auto it = std::upper_bound(m_tokens.begin(), m_tokens.end(), position,
+        [](int64_t value, const Token& token) { return value < token.start; });
+    if (it != m_tokens.begin() && static_cast<int64_t>((it - 1)->start) + (it - 1)->length > position)
+        --it;
+    return it;
+}
+
+XATokenStream::const_iterator XATokenStream::begin() const
+{
+    return m_tokens.begin();
+}
+
+XATokenStream::const_iterator XATokenStream::end() const
+{
+    return m_tokens.end();
+}
+
+size_t XATokenStream::size() const
+{
+    return m_tokens.size();
+}
+
+size_t XATokenStream::memoryUsage() const
+{
+    return m_tokens.capacity() * sizeof(Token);
+}
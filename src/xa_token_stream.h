@@ -0,0 +1,87 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class XAOffsetMap;
+
+
+/**
+ * Markup tokens of a document in text order, collected by the structural scan of XASpanIndex,
+ * so syntax highlighting follows the same reading of the markup as the tree.
+ * Tokens do not overlap, the tokens of a text range are found by a binary search.
+ * Offsets are bytes while the scan runs, translate turns them into editor positions.
+ * Offsets are 32 bit to keep tokens small, no stream is collected for a text above MaxTextSize.
+ */
+class XATokenStream
+{
+public:
+    enum Kind : uint8_t
+    {
+        ELEMENT,
+        ATTRIBUTE,
+        ATTRIBUTE_VALUE,
+        COMMENT,
+        CDATA,
+        PI_TARGET,
+        PI_VALUE
+    };
+
+    struct Token
+    {
+        int32_t start;
+        int32_t length;
+        Kind    kind;
+    };
+
+    using const_iterator = std::vector<Token>::const_iterator;
+
+    static const size_t MaxTextSize = INT32_MAX;
+
+    XATokenStream();
+
+    /**
+     * Appends the token from start to end, tokens have to be added in text order
+     */
+    void add(size_t start, size_t end, Kind kind);
+
+    /**
+     * Turns the byte offsets of all tokens into editor positions
+     */
+    void translate(const XAOffsetMap& offsets);
+
+    /**
+     * First token that ends behind position, the tokens after it follow in text order up to end()
+     */
+    const_iterator find(int64_t position) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    size_t size() const;
+
+    /**
+     * Bytes held by the stream
+     */
+    size_t memoryUsage() const;
+
+private:
+    std::vector<Token> m_tokens;
+};
@@ -23,26 +23,69 @@
 #include "xa_app.h"
 #include "xa_editor.h"
 #include "xa_find_dialog.h"
+#include "xa_large_file_view.h"
 #include "xa_tableview.h"
 #include "xa_tree_dock.h"
 #include "xa_data.h"
+#include "xa_document.h"
+#include "xa_document_loader.h"
 #include "xa_theme.h"
 #include "xa_xml_tree_model.h"
-#include "xa_xml_tree_item.h"
 #include <QtWidgets>
 #include <QFontDialog>
 
 
+namespace
+{
+    // idle time after the last keystroke before the editor text is parsed again
+    const int LiveParseDelay = 300;
+
+    // elements per range row when long sibling lists are grouped
+    const int SiblingGroupSize = 10000;
+
+    // idle time after the last cursor move before the tree follows the editor cursor
+    const int FollowCursorDelay = 50;
+
+    // idle time after the last cursor move before the tags and the location path are looked up
+    const int CursorLookupDelay = 20;
+
+    // files above this many MB are shown read-only from the file instead of in the editor
+    const int LargeFileThreshold = 256;
+
+    // so are files with a line longer than this, QPlainTextEdit lays out and highlights a line as a whole
+    const size_t LongLineLimit = 64 * 1024;
+}
+
+
 XAMainWindow::XAMainWindow(XAApp* app, XAData* app_data, QWidget* parent)
     : QMainWindow(parent)
     , m_main_window(new Ui::MainWindow)
     , m_app(app)
     , m_app_data(app_data)
     , m_editor(nullptr)
+    , m_large_view(nullptr)
+    , m_central(nullptr)
     , m_xml_highlighter(nullptr)
     , m_tree_dock(nullptr)
     , m_tree_view(nullptr)
     , m_font()
+    , m_skip_reparse(false)
+    , m_loader(nullptr)
+    , m_load_progress(nullptr)
+    , m_load_cancel(nullptr)
+    , m_incremental_parse(nullptr)
+    , m_parser_highlighting(nullptr)
+    , m_live_parser(nullptr)
+    , m_live_parse_timer(nullptr)
+    , m_text_revision(0)
+    , m_tree_stale(false)
+    , m_patch_state()
+    , m_patching_tree(false)
+    , m_follow_cursor(nullptr)
+    , m_follow_cursor_timer(nullptr)
+    , m_following_cursor(false)
+    , m_location_path(nullptr)
+    , m_cursor_lookup_timer(nullptr)
     , m_recent_file_acts()
     , m_recent_file_separator(nullptr)
     , m_recent_file_submenuact(nullptr)
@@ -56,6 +99,10 @@ XAMainWindow::XAMainWindow(XAApp* app, XAData* app_data, QWidget* parent)
     setupDefaults();
     setupEditor();
     setupTableView();
+    setupLoader();
+    setupParseOptions();
+    setupTreeOptions();
+    setupLargeFileOptions();
 
     connect(m_main_window->actionUI_Theme, &QAction::triggered, [this]() { setupTheme(); });
     connect(m_main_window->actionFont, &QAction::triggered, [this]() { setupFont(); });
@@ -73,7 +120,7 @@ XAMainWindow::XAMainWindow(XAApp* app, XAData* app_data, QWidget* parent)
     setupShortCuts();
 
 
-    setCentralWidget(m_editor);
+    setCentralWidget(m_central);
     setWindowTitle(tr("XML Atlas"));
     QIcon icon(":/icons/images/xmlatlas.ico");
     setWindowIcon(icon);
@@ -97,9 +144,23 @@ void XAMainWindow::about()
 
 void XAMainWindow::newFile()
 {
+    // a parse of the old text must not come back into the new one
+    m_live_parse_timer->stop();
+    m_live_parser->cancel();
+    setTreeStale(false);
+
+    // the old document goes as a whole, a large file would otherwise still be saved or edited from its source
+    m_skip_reparse = true;
     m_editor->clear();
-    m_app_data->getXMLTreeModel()->clear();
+    m_skip_reparse = false;
+    m_editor->setReadOnly(false);
+    m_large_view->clear();
+    m_central->setCurrentWidget(m_editor);
+    showInTable(QModelIndex());
+    m_app_data->clear();
+    m_xml_highlighter->setTokenStream(nullptr);
     m_tree_view->reset();
+    m_main_window->actionSave->setEnabled(true);
 
     setWindowTitle(tr("XML Atlas"));
 }
@@ -114,29 +175,84 @@ void XAMainWindow::openFile(const QString& path)
 
     if (!fileName.isEmpty()) 
     {
-        QFile file(fileName);
-        if (file.open(QFile::ReadOnly | QFile::Text))
-        {
-            auto content = file.readAll();
-            auto parse_result = m_app_data->setContent(content);
-            
-            m_app_data->setFilename(fileName);
-            m_editor->setPlainText(content);
-            m_tree_view->expandAll();
+        auto threshold = m_app->getSettings().value("largeFileThresholdMB", LargeFileThreshold).toInt();
+        m_loader->setTextLimit(static_cast<size_t>(threshold) * 1024 * 1024);
+        m_loader->load(fileName);
+    }
+}
+
+void XAMainWindow::onLoadProgress(int percent, const QString& stage)
+{
+    showLoadProgress(true);
+    m_load_progress->setValue(percent);
+    m_main_window->statusbar->showMessage(stage);
+}
 
-            m_tree_view->resizeColumnToContents(0);
+void XAMainWindow::onDocumentLoaded()
+{
+    showLoadProgress(false);
+    m_main_window->statusbar->clearMessage();
 
-            m_tree_view->collapseAll();
-            m_tree_view->expand(m_app_data->getXMLTreeModel()->index(0, 0));
+    // edits made while loading are replaced by the file
+    m_live_parse_timer->stop();
+    m_live_parser->cancel();
+    setTreeStale(false);
 
-            addRecentFile(fileName);
+    auto fileName = m_loader->getFilename();
+    m_app_data->setDocument(m_loader->takeDocument(), m_loader->takeNodeTable());
+    m_app_data->setFilename(fileName);
 
-            {
-                QFileInfo info(fileName);
-                setWindowTitle(QString("%1 - %2").arg(windowTitle()).arg(info.fileName()));
-            }
+    presentDocument();
 
-        }
+    addRecentFile(fileName);
+
+    {
+        QFileInfo info(fileName);
+        setWindowTitle(QString("%1 - %2").arg(windowTitle()).arg(info.fileName()));
+    }
+
+#ifndef QT_NO_DEBUG
+    auto parse_count = m_loader->getParseCount();
+    qDebug() << "loaded" << fileName << "with" << parse_count << "parse(s)";
+    m_main_window->statusbar->showMessage(tr("Loaded with %1 parse(s)").arg(parse_count), 5000);
+#endif
+}
+
+void XAMainWindow::presentDocument()
+{
+    // editor, tree and table all show the parse result of the load,
+    // the editor text must not trigger a second parse
+    m_skip_reparse = true;
+    if (m_app_data->hasContent())
+    {
+        m_large_view->clear();
+        m_editor->setReadOnly(false);
+        m_editor->setPlainText(m_app_data->getContent());
+        m_xml_highlighter->setTokenStream(m_app_data->getTokenStream());
+        m_central->setCurrentWidget(m_editor);
+        m_main_window->actionSave->setEnabled(true);
+    }
+    else
+    {
+        // a file beyond the limit is shown from its mapping, the editor stays empty and can not be typed into
+        m_editor->clear();
+        m_editor->setReadOnly(true);
+        m_large_view->setBuffer(m_app_data->getSource(), m_app_data->getSourceSize(), m_app_data->getRowIndex());
+        m_central->setCurrentWidget(m_large_view);
+        // there are no changes to save, Save As still writes a copy
+        m_main_window->actionSave->setEnabled(false);
+        m_main_window->statusbar->showMessage(tr("Opened read-only, the file is too large or its lines too long for the editor"), 5000);
+    }
+    m_skip_reparse = false;
+
+    auto model = m_app_data->getXMLTreeModel();
+    auto root_index = model->index(0, 0);
+    m_tree_view->expand(root_index);
+    m_tree_view->resizeColumnToContents(0);
+
+    if (root_index.isValid())
+    {
+        showInTable(root_index);
     }
 }
 
@@ -149,39 +265,44 @@ void XAMainWindow::saveFile(const QString& path)
             tr("Save File"), ""
             , "XML Files (*.xml *.XML);; All Files (*)");
 
-    if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QFile::WriteOnly | QFile::Text)) {
-            QTextStream out(&file);
-            out << m_editor->toPlainText();
-            file.close();
-            addRecentFile(fileName);
-        }
-        else {
-            QMessageBox::warning(this, tr("Error"), tr("Cannot save file %1:\n%2.").arg(fileName, file.errorString()));
-        }
-    }
+    if (!fileName.isEmpty())
+        writeFile(fileName);
 }
 
 void XAMainWindow::saveFileAs()
 {
-    QString fileName;
-    if (fileName.isNull())
-        fileName = QFileDialog::getSaveFileName(this,
-            tr("Save File As"), ""
-            , "XML Files (*.xml *.XML);; All Files (*)");
+    QString fileName = QFileDialog::getSaveFileName(this,
+        tr("Save File As"), ""
+        , "XML Files (*.xml *.XML);; All Files (*)");
 
-    if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QFile::WriteOnly | QFile::Text)) {
-            QTextStream out(&file);
-            out << m_editor->toPlainText();
-            file.close();
-            addRecentFile(fileName);
-        }
-        else {
-            QMessageBox::warning(this, tr("Error"), tr("Cannot save file %1:\n%2.").arg(fileName, file.errorString()));
-        }
+    if (!fileName.isEmpty())
+        writeFile(fileName);
+}
+
+void XAMainWindow::writeFile(const QString& fileName)
+{
+    // a large file can not be edited, saving it over itself would truncate the mapping it is shown from
+    if (!m_app_data->hasContent() && QFileInfo(fileName) == QFileInfo(m_app_data->getFilename()))
+    {
+        QMessageBox::information(this, tr("Save"),
+            tr("%1 is shown read-only and has no changes to save.\nUse Save As to write a copy.").arg(fileName));
+        return;
+    }
+
+    QFile file(fileName);
+    if (!m_app_data->hasContent() && file.open(QFile::WriteOnly)) {
+        file.write(m_app_data->getSource(), static_cast<qint64>(m_app_data->getSourceSize()));
+        file.close();
+        addRecentFile(fileName);
+    }
+    else if (m_app_data->hasContent() && file.open(QFile::WriteOnly | QFile::Text)) {
+        QTextStream out(&file);
+        out << m_editor->toPlainText();
+        file.close();
+        addRecentFile(fileName);
+    }
+    else {
+        QMessageBox::warning(this, tr("Error"), tr("Cannot save file %1:\n%2.").arg(fileName, file.errorString()));
     }
 }
 
@@ -202,7 +323,10 @@ void XAMainWindow::cut()
 
 void XAMainWindow::copy()
 {
-    m_editor->copy();
+    if (m_central->currentWidget() == m_large_view)
+        m_large_view->copy();
+    else
+        m_editor->copy();
 }
 
 void XAMainWindow::paste()
@@ -216,19 +340,50 @@ void XAMainWindow::setupEditor()
     m_editor->setFont(m_font);
 
     m_xml_highlighter = new XAHighlighter_XML(m_app, m_editor->document());
+    connect(m_editor, &XAEditor::visibleBlocksChanged, m_xml_highlighter, &XAHighlighter_XML::setVisibleBlocks);
+
+    m_large_view = new XALargeFileView(m_app, this);
+    m_large_view->setFont(m_font);
+
+    m_central = new QStackedWidget(this);
+    m_central->addWidget(m_editor);
+    m_central->addWidget(m_large_view);
 
     m_tree_view = new QTreeView(this);
     m_tree_view->setModel(m_app_data->getXMLTreeModel());
     m_tree_view->setHeaderHidden(true);
+    // all rows are one line, the view does not have to measure each of a long sibling list
+    m_tree_view->setUniformRowHeights(true);
 
     bool ok = connect(m_tree_view->selectionModel(), &QItemSelectionModel::currentRowChanged, this, &XAMainWindow::onSelectionChanged);
 
+    // an incremental patch replaces one item, its subtree keeps the view state it had
+    auto model = m_app_data->getXMLTreeModel();
+    connect(model, &XAXMLTreeModel::nodeAboutToBeReplaced, this, &XAMainWindow::onTreeNodeAboutToBeReplaced);
+    connect(model, &XAXMLTreeModel::nodeReplaced, this, &XAMainWindow::onTreeNodeReplaced);
+
     m_tree_dock = new XATreeDock("XML Tree", this);
     m_tree_dock->setWidget(m_tree_view);
     addDockWidget(Qt::DockWidgetArea::LeftDockWidgetArea, m_tree_dock);
     
-    // Connect the textChanged signal to the slot
-    connect(m_editor, &XAEditor::textChanged, this, &XAMainWindow::onEditorTextChanged);
+    // contentsChange tells which part of the text changed, so the tree can be patched locally
+    connect(m_editor->document(), &QTextDocument::contentsChange, this, &XAMainWindow::onEditorContentsChange);
+
+    // tag matching and the location of the cursor are looked up in the tree once the cursor rests
+    m_location_path = new QLabel(this);
+    m_location_path->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    m_main_window->statusbar->addWidget(m_location_path, 1);
+    m_cursor_lookup_timer = new QTimer(this);
+    m_cursor_lookup_timer->setSingleShot(true);
+    m_cursor_lookup_timer->setInterval(CursorLookupDelay);
+    connect(m_cursor_lookup_timer, &QTimer::timeout, this, &XAMainWindow::onCursorLookupTimeout);
+    connect(m_editor, &XAEditor::cursorPositionChanged, m_cursor_lookup_timer, qOverload<>(&QTimer::start));
+    connect(m_large_view, &XALargeFileView::cursorPositionChanged, m_cursor_lookup_timer, qOverload<>(&QTimer::start));
+
+    connect(m_large_view, &XALargeFileView::copyRefused, this, [this](qint64 length, qint64 max_length) {
+        m_main_window->statusbar->showMessage(tr("Not copied, the selection has %1 MB, at most %2 MB can be copied")
+            .arg(length / (1024 * 1024)).arg(max_length / (1024 * 1024)), 5000);
+        });
 }
 
 void XAMainWindow::setupShortCuts()
@@ -256,6 +411,11 @@ void XAMainWindow::setupShortCuts()
     locateInTreeAction->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_L));
     connect(locateInTreeAction, &QAction::triggered, this, &XAMainWindow::locateInTree);
     addAction(locateInTreeAction);
+
+    QAction* selectEnclosingAction = new QAction(tr("Select enclosing element"), this);
+    selectEnclosingAction->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_E));
+    connect(selectEnclosingAction, &QAction::triggered, this, &XAMainWindow::selectEnclosingElement);
+    m_main_window->menuEdit->addAction(selectEnclosingAction);
 }
 
 
@@ -267,13 +427,301 @@ void XAMainWindow::setupTableView()
     addDockWidget(Qt::BottomDockWidgetArea, tableDockWidget);
 }
 
-void XAMainWindow::onEditorTextChanged()
+void XAMainWindow::setupLoader()
 {
-    QString xmlContent = m_editor->toPlainText();
-    auto parse_result = m_app_data->setContent(xmlContent);
-    m_app_data->buildTreeModelFromContent(parse_result);
-    m_tree_view->reset();
-    m_tree_view->expandAll();
+    m_loader = new XADocumentLoader(this);
+    m_loader->setLineLimit(LongLineLimit);
+
+    m_load_progress = new QProgressBar(this);
+    m_load_progress->setRange(0, 100);
+    m_load_progress->setMaximumWidth(200);
+
+    m_load_cancel = new QToolButton(this);
+    m_load_cancel->setText(tr("Cancel"));
+
+    m_main_window->statusbar->addPermanentWidget(m_load_progress);
+    m_main_window->statusbar->addPermanentWidget(m_load_cancel);
+    showLoadProgress(false);
+
+    connect(m_load_cancel, &QToolButton::clicked, m_loader, &XADocumentLoader::cancel);
+    connect(m_loader, &XADocumentLoader::progress, this, &XAMainWindow::onLoadProgress);
+    connect(m_loader, &XADocumentLoader::loaded, this, &XAMainWindow::onDocumentLoaded);
+    connect(m_loader, &XADocumentLoader::failed, this, [this](const QString& message) {
+        showLoadProgress(false);
+        m_main_window->statusbar->clearMessage();
+        QMessageBox::warning(this, tr("Error"), message);
+        });
+    connect(m_loader, &XADocumentLoader::canceled, this, [this]() {
+        showLoadProgress(false);
+        m_main_window->statusbar->showMessage(tr("Loading canceled"), 3000);
+        });
+}
+
+void XAMainWindow::showLoadProgress(bool visible)
+{
+    m_load_progress->setVisible(visible);
+    m_load_cancel->setVisible(visible);
+}
+
+void XAMainWindow::setupParseOptions()
+{
+    auto& settings = m_app->getSettings();
+
+    m_incremental_parse = new QAction(tr("Incremental parsing"), this);
+    m_incremental_parse->setCheckable(true);
+    m_incremental_parse->setChecked(settings.value("incrementalParse", true).toBool());
+    connect(m_incremental_parse, &QAction::toggled, this, [this](bool checked) {
+        m_app->getSettings().setValue("incrementalParse", checked);
+        });
+    m_main_window->menuOptions->addAction(m_incremental_parse);
+
+    m_live_parser = new XADocumentLoader(this);
+    connect(m_live_parser, &XADocumentLoader::loaded, this, &XAMainWindow::onLiveParsed);
+
+    m_live_parse_timer = new QTimer(this);
+    m_live_parse_timer->setSingleShot(true);
+    m_live_parse_timer->setInterval(LiveParseDelay);
+    connect(m_live_parse_timer, &QTimer::timeout, this, &XAMainWindow::onLiveParseTimeout);
+
+    // the scan that indexes the spans for the tree also yields the tokens, highlighting then reads the markup alike
+    m_parser_highlighting = new QAction(tr("Highlight from parser"), this);
+    m_parser_highlighting->setCheckable(true);
+    m_parser_highlighting->setChecked(settings.value("parserHighlighting", false).toBool());
+    connect(m_parser_highlighting, &QAction::toggled, this, [this](bool checked) {
+        m_app->getSettings().setValue("parserHighlighting", checked);
+        m_loader->setCollectTokens(checked);
+        m_live_parser->setCollectTokens(checked);
+        if (!checked)
+            m_xml_highlighter->setTokenStream(nullptr);
+        });
+    m_loader->setCollectTokens(m_parser_highlighting->isChecked());
+    m_live_parser->setCollectTokens(m_parser_highlighting->isChecked());
+    m_main_window->menuOptions->addAction(m_parser_highlighting);
+}
+
+void XAMainWindow::setupTreeOptions()
+{
+    auto& settings = m_app->getSettings();
+
+    auto group_siblings = new QAction(tr("Group long sibling lists"), this);
+    group_siblings->setCheckable(true);
+    group_siblings->setChecked(settings.value("groupSiblings", true).toBool());
+    m_app_data->getXMLTreeModel()->setSiblingGroupSize(group_siblings->isChecked() ? SiblingGroupSize : 0);
+    connect(group_siblings, &QAction::toggled, this, [this](bool checked) {
+        m_app->getSettings().setValue("groupSiblings", checked);
+        m_app_data->getXMLTreeModel()->setSiblingGroupSize(checked ? SiblingGroupSize : 0);
+        m_tree_view->expand(m_app_data->getXMLTreeModel()->index(0, 0));
+        });
+    m_main_window->menuOptions->addAction(group_siblings);
+
+    m_follow_cursor = new QAction(tr("Tree follows cursor"), this);
+    m_follow_cursor->setCheckable(true);
+    m_follow_cursor->setChecked(settings.value("followCursor", false).toBool());
+    connect(m_follow_cursor, &QAction::toggled, this, [this](bool checked) {
+        m_app->getSettings().setValue("followCursor", checked);
+        });
+    m_main_window->menuOptions->addAction(m_follow_cursor);
+
+    // a held arrow key moves the cursor faster than it is worth looking up every step
+    m_follow_cursor_timer = new QTimer(this);
+    m_follow_cursor_timer->setSingleShot(true);
+    m_follow_cursor_timer->setInterval(FollowCursorDelay);
+    connect(m_follow_cursor_timer, &QTimer::timeout, this, &XAMainWindow::onFollowCursorTimeout);
+    auto follow = [this]() {
+        if (m_follow_cursor->isChecked())
+            m_follow_cursor_timer->start();
+    };
+    connect(m_editor, &XAEditor::cursorPositionChanged, this, follow);
+    connect(m_large_view, &XALargeFileView::cursorPositionChanged, this, follow);
+}
+
+void XAMainWindow::setupLargeFileOptions()
+{
+    auto threshold = new QAction(tr("Large file threshold..."), this);
+    connect(threshold, &QAction::triggered, this, [this]() {
+        auto& settings = m_app->getSettings();
+        bool ok = false;
+        auto mb = QInputDialog::getInt(this, tr("Large file threshold"),
+            tr("Files above this size in MB open read-only without the editor:"),
+            settings.value("largeFileThresholdMB", LargeFileThreshold).toInt(), 1, 1024 * 1024, 1, &ok);
+        if (ok)
+            settings.setValue("largeFileThresholdMB", mb);
+        });
+    m_main_window->menuOptions->addAction(threshold);
+}
+
+void XAMainWindow::onEditorContentsChange(int position, int chars_removed, int chars_added)
+{
+    if (m_skip_reparse)
+        return;
+
+    m_app_data->updateContent(m_editor->document(), position, chars_removed, chars_added);
+    ++m_text_revision;
+
+    // a stale tree does not match the text anymore, only a full parse can catch up
+    if (!m_tree_stale && m_incremental_parse->isChecked())
+    {
+        m_patching_tree = true;
+        bool patched = m_app_data->applyEdit(m_editor->document(), position, chars_removed, chars_added);
+        m_patching_tree = false;
+        if (patched)
+            return;
+    }
+
+    // parse on a worker once typing pauses, the tree shows the last good parse until then
+    setTreeStale(true);
+    m_live_parse_timer->start();
+}
+
+void XAMainWindow::onLiveParseTimeout()
+{
+    m_live_parser->parseText(m_app_data->getContentBuffer(), m_text_revision);
+}
+
+void XAMainWindow::onLiveParsed()
+{
+    // the text changed while parsing, the timer already runs for the newer revision
+    if (m_live_parser->getRevision() != m_text_revision)
+        return;
+
+    auto state = saveTreeViewState(QModelIndex(), 0, -1);
+    m_app_data->setDocument(m_live_parser->takeDocument(), m_live_parser->takeNodeTable());
+    m_xml_highlighter->setTokenStream(m_app_data->getTokenStream());
+    setTreeStale(false);
+
+    if (!restoreTreeViewState(state, QModelIndex()))
+    {
+        // the selection did not survive, the table must not keep a node of the old document
+        showInTable(m_app_data->getXMLTreeModel()->index(0, 0));
+    }
+}
+
+void XAMainWindow::onTreeNodeAboutToBeReplaced(const QModelIndex& index)
+{
+    m_patch_state = saveTreeViewState(index.parent(), index.row(), index.row());
+}
+
+void XAMainWindow::onTreeNodeReplaced(const QModelIndex& index)
+{
+    auto parent = index.parent();
+    if (!restoreTreeViewState(m_patch_state, parent))
+    {
+        // the table shows replaced nodes if the current row was patched away or is an ancestor of it
+        auto current = m_tree_view->currentIndex();
+        bool refresh = !m_patch_state.current.isEmpty();
+        for (auto ancestor = parent; ancestor.isValid() && !refresh; ancestor = ancestor.parent())
+            refresh = ancestor == current.sibling(current.row(), 0);
+
+        if (refresh)
+            showInTable(current);
+    }
+    m_patch_state = TreeViewState();
+}
+
+XAMainWindow::TreeViewState XAMainWindow::saveTreeViewState(const QModelIndex& parent, int first, int last) const
+{
+    auto model = m_app_data->getXMLTreeModel();
+    if (last < 0)
+        last = model->rowCount(parent) - 1;
+
+    TreeViewState state;
+    for (int row = first; row <= last; ++row)
+    {
+        auto index = model->index(row, 0, parent);
+        if (m_tree_view->isExpanded(index))
+        {
+            state.expanded.append(model->getPath(index, parent));
+            collectExpanded(index, parent, state.expanded);
+        }
+    }
+
+    // current and top row only count if they lie in the saved rows
+    auto inRange = [&](QModelIndex index) {
+        while (index.isValid() && index.parent() != parent)
+            index = index.parent();
+        return index.isValid() && index.row() >= first && index.row() <= last;
+    };
+
+    auto current = m_tree_view->currentIndex();
+    if (inRange(current))
+        state.current = model->getPath(current.sibling(current.row(), 0), parent);
+
+    auto top = m_tree_view->indexAt(QPoint(0, 0));
+    if (inRange(top))
+        state.top = model->getPath(top.sibling(top.row(), 0), parent);
+
+    return state;
+}
+
+void XAMainWindow::collectExpanded(const QModelIndex& index, const QModelIndex& base, QStringList& expanded) const
+{
+    // collapsed subtrees are skipped, the walk only costs what is visible
+    auto model = m_app_data->getXMLTreeModel();
+    int rows = model->rowCount(index);
+    for (int row = 0; row < rows; ++row)
+    {
+        auto child = model->index(row, 0, index);
+        if (m_tree_view->isExpanded(child))
+        {
+            expanded.append(model->getPath(child, base));
+            collectExpanded(child, base, expanded);
+        }
+    }
+}
+
+bool XAMainWindow::restoreTreeViewState(const TreeViewState& state, const QModelIndex& parent)
+{
+    auto model = m_app_data->getXMLTreeModel();
+
+    // parents were saved before their children, so each expand finds its parent open
+    for (const auto& path : state.expanded)
+    {
+        auto index = model->indexFromPath(path, parent);
+        if (index.isValid())
+            m_tree_view->expand(index);
+    }
+
+    if (!state.top.isEmpty())
+    {
+        auto top = model->indexFromPath(state.top, parent);
+        if (top.isValid())
+            m_tree_view->scrollTo(top, QAbstractItemView::PositionAtTop);
+    }
+
+    if (state.current.isEmpty())
+        return false;
+
+    auto current = model->indexFromPath(state.current, parent);
+    if (!current.isValid())
+        return false;
+
+    // the user is typing, selecting must not move the editor cursor
+    {
+        QSignalBlocker blocker(m_tree_view->selectionModel());
+        m_tree_view->selectionModel()->setCurrentIndex(current, QItemSelectionModel::ClearAndSelect);
+    }
+    m_tree_view->viewport()->update();
+    showInTable(current);
+    return true;
+}
+
+void XAMainWindow::showInTable(const QModelIndex& index)
+{
+    if (!index.isValid())
+    {
+        m_tableView->setTableRootNode(pugi::xml_node(), 0);
+        return;
+    }
+
+    auto& settings = m_app->getSettings();
+    auto uc = settings.value("uniqueColumns", 2).toInt();
+    m_tableView->setTableRootNode(m_app_data->getXMLTreeModel()->getNode(index), uc);
+}
+
+void XAMainWindow::setTreeStale(bool stale)
+{
+    m_tree_stale = stale;
+    m_tree_dock->setWindowTitle(stale ? tr("XML Tree (outdated)") : tr("XML Tree"));
 }
 
 void XAMainWindow::setupFileMenu()
@@ -301,24 +749,32 @@ void XAMainWindow::setupHelpMenu()
 
 void XAMainWindow::onSelectionChanged(const QModelIndex& index, const QModelIndex& previous)
 {
-    auto item = index.internalPointer();
-    if (item)
+    // removing the patched row moves the current index, that is no user selection
+    if (m_patching_tree)
+        return;
+
+    if (index.isValid())
     {
-        auto tree_item = reinterpret_cast<XAXMLTreeItem*>(item);
+        auto model = m_app_data->getXMLTreeModel();
 
-        // mark
+        // mark, unless the tree follows the editor cursor, which must stay where the user put it
+        if (!m_following_cursor)
         {
-            //auto first = tree_item->getOffset();
-            //auto node = tree_item->getNode();
-            //auto length = node.next_sibling().offset_debug() - first;
-            //m_editor->markSelectedRange(tree_item->getOffset(), length);
-            m_editor->markSelectedRange(tree_item);
+            if (m_central->currentWidget() == m_large_view)
+                m_large_view->markSelectedRange(model->getItemType(index),
+                    model->getOffset(index), model->getEndOffset(index));
+            else
+                m_editor->markSelectedRange(model->getItemType(index),
+                    model->getOffset(index), model->getEndOffset(index));
         }
 
         // update table view
-        auto& settings = m_app->getSettings();
-        auto uc = settings.value("uniqueColumns", 2).toInt();
-        m_tableView->setTableRootNode(tree_item->getNode(), uc);
+        showInTable(index);
+    }
+    else
+    {
+        // the current row was removed by a reparse, its node is gone as well
+        showInTable(QModelIndex());
     }
 }
 
@@ -408,6 +864,7 @@ void XAMainWindow::setupFont()
     if (ok) {
         m_font = font;
         m_editor->setFont(m_font);
+        m_large_view->setFont(m_font);
     }
     else {
         // the user canceled the dialog; font is set to the initial
@@ -446,6 +903,10 @@ void XAMainWindow::indentDocument(bool force_option)
         delete dlg;
     }
 
+    // the indented text would have to go into the editor, which a large file bypasses
+    if (!m_app_data->hasContent())
+        return;
+
     auto content = m_app_data->indentDocument(indent_size, max_attr_per_line, use_spaces);
     m_editor->setPlainText(content);
 }
@@ -504,6 +965,7 @@ void XAMainWindow::changeTheme(const QString& selected_theme)
     {
         m_xml_highlighter->onThemeChange();
     }
+    m_large_view->viewport()->update();
 }
 
 void XAMainWindow::updateRecentFileActions()
@@ -600,72 +1062,103 @@ void XAMainWindow::findPreviousInEditor(const QString& searchTerm)
 
 void XAMainWindow::locateInTree()
 {
-    int cursorPosition = m_editor->textCursor().position();
-    XAXMLTreeItem* matchingItem = findMatchingTreeItem(m_app_data->getXMLTreeModel()->rootItem(), cursorPosition);
+    // offsets of a stale tree do not match the editor text until the next parse
+    if (m_tree_stale || m_patching_tree)
+        return;
 
-    if (matchingItem)
+    auto model = m_app_data->getXMLTreeModel();
+    if (m_following_cursor)
     {
-        QModelIndex index = m_app_data->getXMLTreeModel()->indexFromItem(matchingItem);
+        // the cursor came to rest, the items on the way to its element are created now,
+        // one block of siblings per level and nothing below the element
+        auto location = model->locate(cursorPosition());
+        auto index = model->indexAtLocation(location);
+        if (!index.isValid())
+            return;
+
+        if (index != m_tree_view->currentIndex())
+            m_tree_view->setCurrentIndex(index);
+        m_tree_view->scrollTo(index);
+
+        // the table shows the element under the cursor, also if the way there ended early
+        if (location.element && model->getNode(index) != location.element)
+        {
+            auto uc = m_app->getSettings().value("uniqueColumns", 2).toInt();
+            m_tableView->setTableRootNode(location.element, uc);
+        }
+    }
+    else
+    {
+        auto index = model->indexAtOffset(cursorPosition());
+        if (!index.isValid())
+            return;
+
         m_tree_view->setCurrentIndex(index);
         m_tree_view->expand(index);
     }
 }
 
-XAXMLTreeItem* XAMainWindow::findMatchingTreeItem(XAXMLTreeItem* item, int cursorPosition)
+void XAMainWindow::selectEnclosingElement()
 {
-    if (!item)
-        return nullptr;
-
-    auto offset = item->getOffset();
+    if (m_tree_stale)
+        return;
 
-    // overshoot while looking
-    if (offset != -1 && offset > cursorPosition)
-    {
-        return nullptr;
-    }
+    auto model = m_app_data->getXMLTreeModel();
+    bool large = m_central->currentWidget() == m_large_view;
+    auto cursor = m_editor->textCursor();
+    int64_t start = large ? m_large_view->selectionStart() : cursor.selectionStart();
+    int64_t end = large ? m_large_view->selectionEnd() : cursor.selectionEnd();
 
-    // guess the matching children as good as possible
-    auto children = item->children();
-    XAXMLTreeItem* last_child = nullptr;
-    uint64_t last_child_offset = -1;
-    for (XAXMLTreeItem* child : children)
+    // the innermost element around the selection that is larger than it, so repeated presses widen it
+    for (auto index = model->indexAtOffset(start); index.isValid(); index = index.parent())
     {
-        auto child_offset = child->getOffset();
+        if (model->getItemType(index) != XAXMLTreeItemType::ELEMENT)
+            continue;
 
-        if (last_child != nullptr)
+        auto offset = model->getOffset(index);
+        auto end_offset = model->getEndOffset(index);
+        if (offset - 1 <= start && end_offset >= end && (offset - 1 < start || end_offset > end))
         {
-            if (last_child_offset <= cursorPosition
-                && child_offset > cursorPosition)
-            {
-                XAXMLTreeItem* matchingChild = findMatchingTreeItem(last_child, cursorPosition);
-                if (matchingChild)
-                    return matchingChild;
-            }
+            if (large)
+                m_large_view->selectRange(XAXMLTreeItemType::ELEMENT, offset, end_offset);
+            else
+                m_editor->selectRange(XAXMLTreeItemType::ELEMENT, offset, end_offset);
+            return;
         }
-        else
-        {
-            if (child != nullptr && child_offset >= cursorPosition)
-            {
-                XAXMLTreeItem* matchingChild = findMatchingTreeItem(child, cursorPosition);
-                if (matchingChild)
-                    return matchingChild;
-            }
-        }
-
-        last_child = child;
-        last_child_offset = child_offset;
     }
+}
 
-    
-    // couldnt guess so brute force it in the next level
-    for (XAXMLTreeItem* child : children)
+void XAMainWindow::onCursorLookupTimeout()
+{
+    // offsets of a stale tree do not match the editor text until the next parse
+    if (m_tree_stale || m_patching_tree)
     {
-        XAXMLTreeItem* matchingChild = findMatchingTreeItem(child, cursorPosition);
-        if (matchingChild)
-            return matchingChild;
+        m_editor->markMatchingTags(-1, -1);
+        m_location_path->clear();
+        return;
     }
 
-    // TODO deeper Attribute selection
+    // the lookup creates no tree items, moving the cursor must not grow the tree
+    auto model = m_app_data->getXMLTreeModel();
+    auto location = model->locate(cursorPosition());
+    m_location_path->setText(model->getLocationPath(location.element, location.attribute));
+
+    // the large file view has no tag highlight, on an attribute the tags of its element are matched
+    if (m_central->currentWidget() != m_large_view)
+        m_editor->markMatchingTags(location.offset, location.end);
+}
 
-    return item;
-}
\ No newline at end of file
+void XAMainWindow::onFollowCursorTimeout()
+{
+    m_following_cursor = true;
+    locateInTree();
+    m_following_cursor = false;
+}
+
+int64_t XAMainWindow::cursorPosition() const
+{
+    // tree offsets are editor positions, or byte offsets for a file shown in the large file view
+    if (m_central->currentWidget() == m_large_view)
+        return m_large_view->cursorPosition();
+    return m_editor->textCursor().position();
+}
@@ -19,14 +19,21 @@
 
 #include "xa_highlighter_xml.h"
 #include <QMainWindow>
+#include <QStringList>
 
 class XAApp;
+class XADocumentLoader;
 class XAEditor;
+class XALargeFileView;
 class XATableView;
 class XATreeDock;
 class XAData;
+class QLabel;
+class QProgressBar;
+class QStackedWidget;
+class QTimer;
+class QToolButton;
 class QTreeView;
-class XAXMLTreeItem;
 
 namespace Ui
 {
@@ -62,12 +69,42 @@ protected slots:
     void onThemeChange();
     void onFind();
     void onFindNext();
-    void onEditorTextChanged();
+    void onEditorContentsChange(int position, int chars_removed, int chars_added);
+    void onLoadProgress(int percent, const QString& stage);
+    void onDocumentLoaded();
+    void onLiveParseTimeout();
+    void onLiveParsed();
+    void onTreeNodeAboutToBeReplaced(const QModelIndex& index);
+    void onTreeNodeReplaced(const QModelIndex& index);
+    void onFollowCursorTimeout();
+    void onCursorLookupTimeout();
+
+private:
+    /**
+     * Expansion, current row and scroll position of the tree view by item path,
+     * so the view looks the same after the tree below it was rebuilt
+     */
+    struct TreeViewState
+    {
+        QStringList expanded;
+        QString     current;
+        QString     top;
+    };
 
 private:
     void setupEditor();
     void setupShortCuts();
     void setupTableView();
+    void setupLoader();
+    void setupParseOptions();
+    void setupTreeOptions();
+    void showLoadProgress(bool visible);
+    void presentDocument();
+    void setTreeStale(bool stale);
+    TreeViewState saveTreeViewState(const QModelIndex& parent, int first, int last) const;
+    void collectExpanded(const QModelIndex& index, const QModelIndex& base, QStringList& expanded) const;
+    bool restoreTreeViewState(const TreeViewState& state, const QModelIndex& parent);
+    void showInTable(const QModelIndex& index);
     void setupFileMenu();
     void setupHelpMenu();
     void setupTheme();
@@ -78,22 +115,44 @@ private:
     void updateRecentFileActions();
     void openRecentFile();
     void addRecentFile(const QString& file_path);
+    void writeFile(const QString& fileName);
     void findInEditor(const QString& searchTerm);
     void findPreviousInEditor(const QString& searchTerm);
     void locateInTree();
-    XAXMLTreeItem* findMatchingTreeItem(XAXMLTreeItem* item, int cursorPosition);
+    void selectEnclosingElement();
+    void setupLargeFileOptions();
+    int64_t cursorPosition() const;
 
 private:
     Ui::MainWindow*     m_main_window;
     XAApp*              m_app;
     XAData*             m_app_data;
     XAEditor*           m_editor;
+    XALargeFileView*    m_large_view;
+    QStackedWidget*     m_central;
     QTextCursor         m_searchCursor;
     XATableView*        m_tableView;
     XAHighlighter_XML*  m_xml_highlighter;
     XATreeDock*         m_tree_dock;
     QTreeView*          m_tree_view;
     QFont               m_font;
+    bool                m_skip_reparse;
+    XADocumentLoader*   m_loader;
+    QProgressBar*       m_load_progress;
+    QToolButton*        m_load_cancel;
+    QAction*            m_incremental_parse;
+    QAction*            m_parser_highlighting;
+    XADocumentLoader*   m_live_parser;
+    QTimer*             m_live_parse_timer;
+    int                 m_text_revision;
+    bool                m_tree_stale;
+    TreeViewState       m_patch_state;
+    bool                m_patching_tree;
+    QAction*            m_follow_cursor;
+    QTimer*             m_follow_cursor_timer;
+    bool                m_following_cursor;
+    QLabel*             m_location_path;
+    QTimer*             m_cursor_lookup_timer;
 
     enum { MaxRecentFiles = 10 };
     QAction* m_recent_file_acts[MaxRecentFiles];
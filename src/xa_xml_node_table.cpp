@@ -0,0 +1,357 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xa_xml_node_table.h"
+
+
+namespace
+{
+    const int32_t NotFetched = -1;
+    const int32_t EmptyBlock = 0;
+
+    const int TypeBits = 2;
+    const uint16_t TypeMask = (1 << TypeBits) - 1;
+    const uint8_t NoOffsetHigh = 0xff;
+}
+
+
+XAXMLNodeTable::XAXMLNodeTable()
+    : m_parent()
+    , m_block()
+    , m_handle()
+    , m_offset()
+    , m_offset_high()
+    , m_state()
+    , m_blocks()
+    , m_free_blocks()
+    , m_ranges()
+    , m_ends()
+    , m_sources()
+    , m_error()
+{
+    m_blocks.push_back({ 0, 0 });
+    allocate(NoId);
+}
+
+size_t XAXMLNodeTable::size() const
+{
+    return m_parent.size();
+}
+
+bool XAXMLNodeTable::isUsed(Id id) const
+{
+    return id == RootId || m_parent[id] != NoId;
+}
+
+size_t XAXMLNodeTable::memoryUsage() const
+{
+    return m_parent.capacity() * sizeof(Id)
+        + m_block.capacity() * sizeof(int32_t)
+        + m_handle.capacity() * sizeof(void*)
+        + m_offset.capacity() * sizeof(uint32_t)
+        + m_offset_high.capacity() * sizeof(uint8_t)
+        + m_state.capacity() * sizeof(uint16_t)
+        + m_blocks.capacity() * sizeof(Block)
+        + m_free_blocks.size() * (sizeof(int) + sizeof(int32_t))
+        + m_ranges.size() * (sizeof(Id) + sizeof(Range))
+        + m_ends.size() * (sizeof(Id) + sizeof(int64_t))
+        + m_sources.size() * (sizeof(Id) + sizeof(Source));
+}
+
+XAXMLNodeTable::Id XAXMLNodeTable::parent(Id id) const
+{
+    return m_parent[id];
+}
+
+int XAXMLNodeTable::row(Id id) const
+{
+    auto parent_id = m_parent[id];
+    if (parent_id == NoId)
+        return 0;
+    return id - m_blocks[m_block[parent_id]].first;
+}
+
+bool XAXMLNodeTable::isFetched(Id id) const
+{
+    return m_block[id] != NotFetched;
+}
+
+int XAXMLNodeTable::childCount(Id id) const
+{
+    auto block = m_block[id];
+    if (block == NotFetched)
+        return 0;
+    return m_blocks[block].count;
+}
+
+XAXMLNodeTable::Id XAXMLNodeTable::child(Id id, int row) const
+{
+    if (row < 0 || row >= childCount(id))
+        return NoId;
+    return m_blocks[m_block[id]].first + row;
+}
+
+XAXMLTreeItemType XAXMLNodeTable::type(Id id) const
+{
+    return static_cast<XAXMLTreeItemType>(m_state[id] & TypeMask);
+}
+
+pugi::xml_node XAXMLNodeTable::node(Id id) const
+{
+    if (type(id) == XAXMLTreeItemType::ATTRIBUTE)
+        return node(m_parent[id]);
+    return pugi::xml_node(static_cast<pugi::xml_node_struct*>(m_handle[id]));
+}
+
+pugi::xml_attribute XAXMLNodeTable::attribute(Id id) const
+{
+    if (type(id) != XAXMLTreeItemType::ATTRIBUTE)
+        return pugi::xml_attribute();
+    return pugi::xml_attribute(static_cast<pugi::xml_attribute_struct*>(m_handle[id]));
+}
+
+const char* XAXMLNodeTable::name(Id id) const
+{
+    switch (type(id))
+    {
+    case XAXMLTreeItemType::ELEMENT:
+    case XAXMLTreeItemType::RANGE:      return node(id).name();
+    case XAXMLTreeItemType::ATTRIBUTE:  return attribute(id).name();
+    case XAXMLTreeItemType::ERROR:      return m_error.c_str();
+    }
+    return "";
+}
+
+int64_t XAXMLNodeTable::offset(Id id) const
+{
+    if (m_offset_high[id] == NoOffsetHigh)
+        return -1;
+    return (int64_t(m_offset_high[id]) << 32) | m_offset[id];
+}
+
+int XAXMLNodeTable::epoch(Id id) const
+{
+    return m_state[id] >> TypeBits;
+}
+
+void XAXMLNodeTable::setOffset(Id id, int64_t offset, int epoch)
+{
+    // byte offsets of a file without editor text can be beyond 4 GB, the high byte 0xff marks no offset
+    if (offset < 0 || offset >= MaxOffset)
+    {
+        m_offset[id] = 0;
+        m_offset_high[id] = NoOffsetHigh;
+    }
+    else
+    {
+        m_offset[id] = static_cast<uint32_t>(offset);
+        m_offset_high[id] = static_cast<uint8_t>(offset >> 32);
+    }
+    m_state[id] = static_cast<uint16_t>((epoch << TypeBits) | (m_state[id] & TypeMask));
+}
+
+bool XAXMLNodeTable::hasEnd(Id id) const
+{
+    return m_ends.count(id) != 0;
+}
+
+int64_t XAXMLNodeTable::end(Id id) const
+{
+    auto it = m_ends.find(id);
+    return it != m_ends.end() ? it->second : -1;
+}
+
+void XAXMLNodeTable::setEnd(Id id, int64_t end)
+{
+    m_ends[id] = end;
+}
+
+void XAXMLNodeTable::clearEnd(Id id)
+{
+    m_ends.erase(id);
+}
+
+XAXMLNodeTable::Id XAXMLNodeTable::createChildren(Id id, int count)
+{
+    if (count == 0)
+    {
+        m_block[id] = EmptyBlock;
+        return NoId;
+    }
+
+    // the smallest free block that is large enough, what is left of it stays free
+    auto it = m_free_blocks.lower_bound(count);
+    if (it != m_free_blocks.end())
+    {
+        auto block = it->second;
+        m_free_blocks.erase(it);
+
+        auto first = m_blocks[block].first;
+        auto rest = m_blocks[block].count - count;
+        if (rest > 0)
+        {
+            m_blocks[block].count = count;
+            m_free_blocks.emplace(rest, addBlock(first + count, rest));
+        }
+
+        for (auto child = first; child < first + count; ++child)
+        {
+            m_parent[child] = id;
+        }
+        m_block[id] = block;
+        return first;
+    }
+
+    auto first = static_cast<Id>(m_parent.size());
+    for (int i = 0; i < count; ++i)
+    {
+        allocate(id);
+    }
+
+    m_block[id] = addBlock(first, count);
+    return first;
+}
+
+void XAXMLNodeTable::setElement(Id id, const pugi::xml_node& node)
+{
+    m_handle[id] = node.internal_object();
+    setType(id, XAXMLTreeItemType::ELEMENT);
+}
+
+void XAXMLNodeTable::setAttribute(Id id, const pugi::xml_attribute& attribute)
+{
+    m_handle[id] = attribute.internal_object();
+    setType(id, XAXMLTreeItemType::ATTRIBUTE);
+    m_block[id] = EmptyBlock;
+}
+
+void XAXMLNodeTable::setError(Id id, const pugi::xml_node& node, const char* description)
+{
+    m_handle[id] = node.internal_object();
+    setType(id, XAXMLTreeItemType::ERROR);
+    m_block[id] = EmptyBlock;
+    m_error = description;
+}
+
+void XAXMLNodeTable::setRange(Id id, const pugi::xml_node& node, int first, int count)
+{
+    m_handle[id] = node.internal_object();
+    setType(id, XAXMLTreeItemType::RANGE);
+    m_ranges[id] = { first, count };
+}
+
+int XAXMLNodeTable::rangeFirst(Id id) const
+{
+    auto it = m_ranges.find(id);
+    return it != m_ranges.end() ? it->second.first : 0;
+}
+
+int XAXMLNodeTable::rangeCount(Id id) const
+{
+    auto it = m_ranges.find(id);
+    return it != m_ranges.end() ? it->second.count : 0;
+}
+
+void XAXMLNodeTable::setNode(Id id, const pugi::xml_node& node)
+{
+    m_handle[id] = node.internal_object();
+}
+
+void XAXMLNodeTable::setSource(Id id, const pugi::xml_node& source, std::shared_ptr<const XAXMLPatch> patch)
+{
+    m_sources[id] = { source.internal_object(), std::move(patch) };
+}
+
+pugi::xml_node XAXMLNodeTable::source(Id id) const
+{
+    auto it = m_sources.find(id);
+    if (it == m_sources.end())
+        return pugi::xml_node();
+    return pugi::xml_node(static_cast<pugi::xml_node_struct*>(it->second.node));
+}
+
+const std::shared_ptr<const XAXMLPatch>& XAXMLNodeTable::patch(Id id) const
+{
+    static const std::shared_ptr<const XAXMLPatch> none;
+
+    auto it = m_sources.find(id);
+    return it != m_sources.end() ? it->second.patch : none;
+}
+
+void XAXMLNodeTable::resetChildren(Id id)
+{
+    auto block = m_block[id];
+    m_block[id] = NotFetched;
+    if (block == NotFetched || block == EmptyBlock)
+        return;
+
+    // the blocks of the whole subtree are freed, not only the one of the children
+    std::vector<int32_t> blocks(1, block);
+    while (!blocks.empty())
+    {
+        block = blocks.back();
+        blocks.pop_back();
+
+        auto first = m_blocks[block].first;
+        auto count = m_blocks[block].count;
+        for (auto child = first; child < first + count; ++child)
+        {
+            if (m_block[child] != NotFetched && m_block[child] != EmptyBlock)
+                blocks.push_back(m_block[child]);
+            release(child);
+        }
+        m_free_blocks.emplace(count, block);
+    }
+}
+
+XAXMLNodeTable::Id XAXMLNodeTable::allocate(Id parent_id)
+{
+    auto id = static_cast<Id>(m_parent.size());
+    m_parent.push_back(parent_id);
+    m_block.push_back(NotFetched);
+    m_handle.push_back(nullptr);
+    m_offset.push_back(0);
+    m_offset_high.push_back(NoOffsetHigh);
+    m_state.push_back(static_cast<uint16_t>(XAXMLTreeItemType::ELEMENT));
+    return id;
+}
+
+void XAXMLNodeTable::release(Id id)
+{
+    m_parent[id] = NoId;
+    m_block[id] = NotFetched;
+    m_handle[id] = nullptr;
+    m_offset[id] = 0;
+    m_offset_high[id] = NoOffsetHigh;
+    m_state[id] = static_cast<uint16_t>(XAXMLTreeItemType::ELEMENT);
+    m_ranges.erase(id);
+    m_ends.erase(id);
+    m_sources.erase(id);
+}
+
+int32_t XAXMLNodeTable::addBlock(Id first, int count)
+{
+    // blocks split off a free one are new entries, all of them stay disjoint, so there are never more than ids
+    m_blocks.push_back({ first, count });
+    return static_cast<int32_t>(m_blocks.size() - 1);
+}
+
+void XAXMLNodeTable::setType(Id id, XAXMLTreeItemType type)
+{
+    m_state[id] = static_cast<uint16_t>((m_state[id] & ~TypeMask) | static_cast<uint16_t>(type));
+}
@@ -0,0 +1,208 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <pugixml.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct XAXMLPatch;
+
+
+enum class XAXMLTreeItemType : uint8_t
+{
+    ELEMENT,
+    ATTRIBUTE,
+    ERROR,
+    RANGE
+};
+
+
+/**
+ * The items of the XML tree as flat arrays indexed by item id.
+ * The children of an item are created together and occupy one contiguous block of ids,
+ * so the row of an item is its distance to the start of the block.
+ * Id 0 is the invisible root, its children are the top level items.
+ * An item takes 23 bytes: parent, block, handle, a 40 bit offset and 16 bits for type and epoch.
+ * Ends are not kept per item, the model takes them from the span index. The few it can not,
+ * ranges and items whose text changed length, have their end in a side table.
+ * The ids of removed items are handed out again by createChildren.
+ */
+class XAXMLNodeTable
+{
+public:
+    using Id = int32_t;
+
+    enum : Id
+    {
+        NoId = -1,
+        RootId = 0
+    };
+
+    /**
+     * Largest edit epoch an item can carry
+     */
+    static const int MaxEpoch = 0x3fff;
+
+    /**
+     * Offsets from here on are stored as not known
+     */
+    static const int64_t MaxOffset = int64_t(0xff) << 32;
+
+    XAXMLNodeTable();
+
+    /**
+     * Number of ids handed out, including the free ones
+     */
+    size_t size() const;
+
+    /**
+     * Whether the id belongs to an item, the ids of removed items wait to be reused
+     */
+    bool isUsed(Id id) const;
+
+    /**
+     * Bytes held by the table
+     */
+    size_t memoryUsage() const;
+
+    Id parent(Id id) const;
+    int row(Id id) const;
+
+    /**
+     * Whether the children of the item were created
+     */
+    bool isFetched(Id id) const;
+    int childCount(Id id) const;
+    Id child(Id id, int row) const;
+
+    XAXMLTreeItemType type(Id id) const;
+
+    /**
+     * Element of the item, for an attribute the element it belongs to,
+     * for a range the first element in it
+     */
+    pugi::xml_node node(Id id) const;
+    pugi::xml_attribute attribute(Id id) const;
+
+    /**
+     * Element or attribute name, the parse error description for an error item
+     */
+    const char* name(Id id) const;
+
+    /**
+     * Offset of the item when it was set at edit epoch, see XAXMLTreeModel::getOffset
+     */
+    int64_t offset(Id id) const;
+    int epoch(Id id) const;
+    void setOffset(Id id, int64_t offset, int epoch);
+
+    /**
+     * End of the item text at the epoch of its offset, for items whose end is kept here
+     */
+    bool hasEnd(Id id) const;
+    int64_t end(Id id) const;
+    void setEnd(Id id, int64_t end);
+    void clearEnd(Id id);
+
+    /**
+     * Creates count children of the item in one block, the returned id is the one in row 0
+     * The item must not have children yet, see resetChildren.
+     */
+    Id createChildren(Id id, int count);
+
+    void setElement(Id id, const pugi::xml_node& node);
+    void setAttribute(Id id, const pugi::xml_attribute& attribute);
+    void setError(Id id, const pugi::xml_node& node, const char* description);
+
+    /**
+     * Makes the item stand for count sibling elements starting with node
+     * first is the position of node among the element children of its parent.
+     */
+    void setRange(Id id, const pugi::xml_node& node, int first, int count);
+    int rangeFirst(Id id) const;
+    int rangeCount(Id id) const;
+
+    /**
+     * Replaces the node of the item without touching its children
+     */
+    void setNode(Id id, const pugi::xml_node& node);
+
+    /**
+     * Node the item was copied from and the patch holding it, for items below a replaced element
+     * Such items take their offsets and spans from the patch, source is empty for all others.
+     */
+    void setSource(Id id, const pugi::xml_node& source, std::shared_ptr<const XAXMLPatch> patch);
+    pugi::xml_node source(Id id) const;
+    const std::shared_ptr<const XAXMLPatch>& patch(Id id) const;
+
+    /**
+     * Removes all items below the item, it can be fetched again
+     * Their ids are free for later children.
+     */
+    void resetChildren(Id id);
+
+private:
+    Id allocate(Id parent_id);
+    void setType(Id id, XAXMLTreeItemType type);
+    void release(Id id);
+    int32_t addBlock(Id first, int count);
+
+private:
+    struct Block
+    {
+        Id  first;
+        int count;
+    };
+
+    // one entry per id, the state holds the type in its low 2 bits and the epoch above
+    std::vector<Id>                 m_parent;
+    std::vector<int32_t>            m_block;
+    std::vector<void*>              m_handle;
+    std::vector<uint32_t>           m_offset;
+    std::vector<uint8_t>            m_offset_high;
+    std::vector<uint16_t>           m_state;
+
+    struct Range
+    {
+        int first;
+        int count;
+    };
+
+    struct Source
+    {
+        void*                               node;
+        std::shared_ptr<const XAXMLPatch>   patch;
+    };
+
+    // one entry per item with fetched children, block 0 is shared by all without any
+    std::vector<Block>              m_blocks;
+
+    // free blocks by their count, a larger one is split
+    std::multimap<int, int32_t>     m_free_blocks;
+
+    std::unordered_map<Id, Range>   m_ranges;
+    std::unordered_map<Id, int64_t> m_ends;
+    std::unordered_map<Id, Source>  m_sources;
+    std::string                     m_error;
+};
@@ -0,0 +1,252 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "xa_xml_tree_builder.h"
+#include <algorithm>
+
+
+namespace
+{
+    int countAttributes(const pugi::xml_node& node)
+    {
+        int count = 0;
+        for (auto attr = node.first_attribute(); attr; attr = attr.next_attribute())
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    int countElements(const pugi::xml_node& node)
+    {
+        int count = 0;
+        for (auto child = node.first_child(); child; child = child.next_sibling())
+        {
+            if (child.type() == pugi::node_element)
+                ++count;
+        }
+        return count;
+    }
+
+    /**
+     * Elements covered by one row, ranges nest until a level has at most group_size rows
+     */
+    int64_t rangeSpan(int elements, int group_size)
+    {
+        if (group_size <= 1 || elements <= group_size)
+            return 1;
+
+        int64_t span = group_size;
+        while ((elements + span - 1) / span > group_size)
+        {
+            span *= group_size;
+        }
+        return span;
+    }
+
+    /**
+     * Editor position of a byte offset, moved by shift, -1 stays -1
+     */
+    int64_t position(int64_t offset, int64_t shift, const XAOffsetMap& offsets)
+    {
+        return offset < 0 ? -1 : shift + offsets.toPosition(offset);
+    }
+
+    /**
+     * Creates the attribute items of target from child_id on, returns the id behind them
+     * The spans are looked up for source, an attribute without one is placed at its element.
+     */
+    XAXMLNodeTable::Id buildAttributes(XAXMLNodeTable& table, XAXMLNodeTable::Id child_id,
+        const pugi::xml_node& source, const pugi::xml_node& target, int64_t offset, int64_t shift, int epoch,
+        const XAOffsetMap& offsets, const XASpanIndex& spans)
+    {
+        auto attribute_spans = offset < 0 ? std::vector<XASpanIndex::Span>() : spans.attributeSpans(source.offset_debug());
+
+        size_t index = 0;
+        for (const auto& attr : target.attributes())
+        {
+            table.setAttribute(child_id, attr);
+            if (index < attribute_spans.size())
+            {
+                const auto& span = attribute_spans[index];
+                table.setOffset(child_id, position(span.offset, shift, offsets), epoch);
+            }
+            else
+            {
+                table.setOffset(child_id, offset, epoch);
+            }
+            ++index;
+            ++child_id;
+        }
+        return child_id;
+    }
+}
+
+
+XAXMLPatch::XAXMLPatch(std::string fragment, int64_t position)
+    : text(std::move(fragment))
+    , document()
+    , result()
+    , offsets()
+    , spans()
+    , base(position)
+{
+    // the maps walk text, which stays where it is for the lifetime of the patch
+    result = document.load_buffer(text.data(), text.size(), pugi::parse_default, pugi::encoding_utf8);
+    offsets = XAOffsetMap(text.data(), text.size());
+    spans = XASpanIndex(text.data(), text.size());
+}
+
+
+XAXMLTreeBuilder::XAXMLTreeBuilder(const pugi::xml_parse_result& parse_result)
+    : m_parse_result(parse_result)
+{
+}
+
+void XAXMLTreeBuilder::build(pugi::xml_document& doc, XAXMLNodeTable& table, const XAOffsetMap& offsets)
+{
+    int count = 0;
+    for (const auto& node : doc.children())
+    {
+        if (node.type() == pugi::node_element)
+            ++count;
+    }
+
+    // the error sits on the top level, where it is seen without expanding anything
+    bool has_error = m_parse_result.status != pugi::status_ok;
+
+    auto id = table.createChildren(XAXMLNodeTable::RootId, count + (has_error ? 1 : 0));
+    for (const auto& node : doc.children())
+    {
+        if (node.type() == pugi::node_element)
+        {
+            table.setElement(id, node);
+            auto offset = node.offset_debug();
+            table.setOffset(id, position(offset, 0, offsets), 0);
+            ++id;
+        }
+    }
+
+    if (has_error)
+    {
+        table.setError(id, doc, m_parse_result.description());
+    }
+}
+
+int XAXMLTreeBuilder::countRows(const XAXMLNodeTable& table, XAXMLNodeTable::Id id, int group_size)
+{
+    int attributes = 0;
+    int elements = 0;
+
+    switch (table.type(id))
+    {
+    case XAXMLTreeItemType::ELEMENT:
+        attributes = countAttributes(table.node(id));
+        elements = countElements(table.node(id));
+        break;
+    case XAXMLTreeItemType::RANGE:
+        elements = table.rangeCount(id);
+        break;
+    default:
+        return 0;
+    }
+
+    auto span = rangeSpan(elements, group_size);
+    return attributes + static_cast<int>((elements + span - 1) / span);
+}
+
+void XAXMLTreeBuilder::buildChildren(XAXMLNodeTable& table, XAXMLNodeTable::Id id, int count,
+    int64_t offset, int epoch, int group_size, const pugi::xml_node& source,
+    const XAOffsetMap& offsets, const XASpanIndex& spans, const std::shared_ptr<const XAXMLPatch>& patch)
+{
+    // an unexpanded subtree was not touched by edits, its nodes keep their distance to the item
+    auto node = table.node(id);
+    auto node_offset = offsets.toPosition(source.offset_debug());
+    auto shift = offset - node_offset;
+    auto located = [&](int64_t child_offset) {
+        return offset < 0 || node_offset < 0 ? -1 : position(child_offset, shift, offsets);
+    };
+
+    auto child_id = table.createChildren(id, count);
+
+    // a copy has the same nodes as its source, both lists are walked side by side
+    pugi::xml_node first;
+    pugi::xml_node first_source;
+    int first_ordinal = 0;
+    int elements = 0;
+    if (table.type(id) == XAXMLTreeItemType::RANGE)
+    {
+        first = node;
+        first_source = source;
+        first_ordinal = table.rangeFirst(id);
+        elements = table.rangeCount(id);
+    }
+    else
+    {
+        child_id = buildAttributes(table, child_id, source, node, node_offset < 0 ? -1 : offset, shift, epoch, offsets, spans);
+        first = node.first_child();
+        first_source = source.first_child();
+        elements = countElements(node);
+    }
+
+    auto span = rangeSpan(elements, group_size);
+    int ordinal = 0;
+    int64_t row_offset = -1;
+    auto child_source = first_source;
+    for (auto child = first; child && child_source && ordinal < elements; child = child.next_sibling(), child_source = child_source.next_sibling())
+    {
+        if (child.type() != pugi::node_element)
+            continue;
+
+        // a range row starts at every span-th element and ends with the last one in it
+        if (ordinal % span == 0)
+        {
+            if (span == 1)
+                table.setElement(child_id, child);
+            else
+                table.setRange(child_id, child, first_ordinal + ordinal, static_cast<int>(std::min<int64_t>(span, elements - ordinal)));
+
+            if (patch)
+                table.setSource(child_id, child_source, patch);
+            row_offset = located(child_source.offset_debug());
+        }
+        if (ordinal % span == span - 1 || ordinal == elements - 1)
+        {
+            table.setOffset(child_id, row_offset, epoch);
+            if (span > 1)
+                table.setEnd(child_id, located(spans.elementEnd(child_source.offset_debug())));
+            ++child_id;
+        }
+        ++ordinal;
+    }
+}
+
+int XAXMLTreeBuilder::countChildren(const pugi::xml_node& node, int limit)
+{
+    int count = 0;
+    for (auto attr = node.first_attribute(); attr && count < limit; attr = attr.next_attribute())
+    {
+        ++count;
+    }
+    for (auto child = node.first_child(); child && count < limit; child = child.next_sibling())
+    {
+        if (child.type() == pugi::node_element)
+            ++count;
+    }
+    return count;
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of XMLAtlas (https://github.com/glaure/xml-atlas)
+ * Copyright (c) 2022 Gunther Laure <gunther.laure@gmail.com>.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "xa_xml_node_table.h"
+#include "xa_offset_map.h"
+#include "xa_span_index.h"
+#include <memory>
+#include <string>
+
+
+/**
+ * An element parsed again after an edit
+ * Its copy in the DOM has no offsets, the items below it look their nodes up here instead.
+ */
+struct XAXMLPatch
+{
+    /**
+     * Parses the text of the element, its '<' is at position in the editor
+     */
+    XAXMLPatch(std::string fragment, int64_t position);
+
+    std::string             text;
+    pugi::xml_document      document;
+    pugi::xml_parse_result  result;
+    XAOffsetMap             offsets;
+    XASpanIndex             spans;
+    int64_t                 base;
+};
+
+
+/**
+ * Creates tree items from the DOM
+ * Only the top level is built up front, the model asks for the children of an item
+ * when the view expands it.
+ */
+class XAXMLTreeBuilder
+{
+public:
+    XAXMLTreeBuilder(const pugi::xml_parse_result& parse_result);
+
+    /**
+     * Creates the top level items of doc below the root of table
+     * Item offsets are editor positions, offsets translates the byte offsets of the DOM.
+     */
+    void build(pugi::xml_document& doc, XAXMLNodeTable& table, const XAOffsetMap& offsets);
+
+    /**
+     * Number of rows buildChildren creates for the item
+     * Element lists longer than group_size are split into range items, 0 keeps them flat.
+     */
+    static int countRows(const XAXMLNodeTable& table, XAXMLNodeTable::Id id, int group_size);
+
+    /**
+     * Creates the count rows below the item, count comes from countRows
+     * Offsets are taken relative to the item, which is at offset since edit epoch.
+     * source is where offsets and spans find the node of the item, the node itself unless it was
+     * copied from patch. The children then get their sources in patch as well.
+     */
+    static void buildChildren(XAXMLNodeTable& table, XAXMLNodeTable::Id id, int count,
+        int64_t offset, int epoch, int group_size, const pugi::xml_node& source,
+        const XAOffsetMap& offsets, const XASpanIndex& spans, const std::shared_ptr<const XAXMLPatch>& patch);
+
+    /**
+     * Number of attributes and element children of node, counting stops at limit
+     */
+    static int countChildren(const pugi::xml_node& node, int limit);
+
+private:
+    pugi::xml_parse_result m_parse_result;
+};
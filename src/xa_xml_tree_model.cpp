@@ -17,22 +17,79 @@
 
 
 #include "xa_xml_tree_model.h"
-#include "xa_xml_tree_item.h"
+#include "xa_xml_tree_builder.h"
 #include "xa_theme.h"
 
 #include <QIcon>
+#include <QStringList>
+#include <algorithm>
+#include <climits>
+#include <cstring>
 
 
+namespace
+{
+    // above this many recorded edits the offsets are applied to all items
+    const size_t MaxPendingEdits = 256;
+
+    // the edit epoch of an item shares 16 bits with its type
+    static_assert(MaxPendingEdits < XAXMLNodeTable::MaxEpoch, "edit epoch does not fit");
+
+    // display data kept for this many rows, a few screens full
+    const int MaxCachedRows = 4096;
+
+    /**
+     * The node in the copy target that is at the place of node in source
+     * node is source or below it, for a range also a later sibling of source or below one.
+     */
+    pugi::xml_node counterpart(const pugi::xml_node& node, const pugi::xml_node& source, const pugi::xml_node& target)
+    {
+        std::vector<int> rows;
+        auto current = node;
+        for (; current != source && current.parent() != source.parent(); current = current.parent())
+        {
+            int row = 0;
+            for (auto previous = current.previous_sibling(); previous; previous = previous.previous_sibling())
+            {
+                ++row;
+            }
+            rows.push_back(row);
+        }
+
+        auto result = target;
+        for (auto sibling = source; result && sibling != current; sibling = sibling.next_sibling())
+        {
+            result = result.next_sibling();
+        }
+        for (auto row = rows.rbegin(); row != rows.rend(); ++row)
+        {
+            result = result.first_child();
+            for (int i = 0; i < *row; ++i)
+            {
+                result = result.next_sibling();
+            }
+        }
+        return result;
+    }
+}
+
 XAXMLTreeModel::XAXMLTreeModel(XATheme* theme, QObject* parent)
     : QAbstractItemModel(parent)
     , m_theme(theme)
+    , m_table(std::make_unique<XAXMLNodeTable>())
+    , m_offsets(std::make_shared<XAOffsetMap>())
+    , m_spans(std::make_shared<XASpanIndex>())
+    , m_edits()
+    , m_group_size(0)
+    , m_row_cache(MaxCachedRows)
+    , m_sibling_steps()
+    , m_locate_steps()
 {
-    m_root_item = new XAXMLTreeItem{ "ROOT"};
+    m_table->createChildren(XAXMLNodeTable::RootId, 0);
 }
 
 XAXMLTreeModel::~XAXMLTreeModel()
 {
-    delete m_root_item;
 }
 
 QVariant XAXMLTreeModel::data(const QModelIndex& index, int role) const
@@ -40,34 +97,16 @@ QVariant XAXMLTreeModel::data(const QModelIndex& index, int role) const
     if (!index.isValid())
         return QVariant();
 
+    auto id = idFromIndex(index);
+
     switch (role)
     {
     case Qt::DisplayRole:
-    {
-        auto item = static_cast<XAXMLTreeItem*>(index.internalPointer());
-        auto node = item->getNode();
-        auto data_value = item->data(index.column());
-
-        switch (item->getItemType())
-        {
-        case XAXMLTreeItemType::ERROR:
-            return data_value;
-            break;
-        case XAXMLTreeItemType::ATTRIBUTE:
-        {
-            QString attr_name = data_value.toString();
-            QString attr_value = node.attribute(attr_name.toStdString().c_str()).value();
-            return QString("%1 = \"%2\"").arg(attr_name).arg(attr_value);
-        } break;
-        case XAXMLTreeItemType::ELEMENT:
-            return data_value;
-            break;
-        }
-    }
+        return cachedRow(id)->display;
 
     case Qt::DecorationRole:
     {
-        auto item = static_cast<XAXMLTreeItem*>(index.internalPointer());
+        auto row = cachedRow(id);
         static QIcon ic_light_element_children = QIcon(":/xml/images/light/element-children.png");
         static QIcon ic_light_element_empty = QIcon(":/xml/images/light/element-empty.png");
         static QIcon ic_light_element_text = QIcon(":/xml/images/light/element-text.png");
@@ -79,9 +118,9 @@ QVariant XAXMLTreeModel::data(const QModelIndex& index, int role) const
         static QIcon ic_dark_error_mark = QIcon(":/xml/images/dark/mark.png");
         static QIcon ic_dark_attribute = QIcon(":/xml/images/dark/equal.png");
         
-        if (m_theme->getColorTheme() == "dark")
+        if (m_theme->getColorTheme() == QLatin1String("dark"))
         {
-            switch (item->getItemType())
+            switch (m_table->type(id))
             {
             case XAXMLTreeItemType::ERROR:
                 return ic_dark_error_mark;
@@ -89,9 +128,12 @@ QVariant XAXMLTreeModel::data(const QModelIndex& index, int role) const
             case XAXMLTreeItemType::ATTRIBUTE:
                 return ic_dark_attribute;
 
+            case XAXMLTreeItemType::RANGE:
+                return ic_dark_element_children;
+
             case XAXMLTreeItemType::ELEMENT:
             {
-                switch (item->childCount())
+                switch (row->child_items)
                 {
                 case 0:  return ic_dark_element_empty;
                 case 1:  return ic_dark_element_text;
@@ -102,7 +144,7 @@ QVariant XAXMLTreeModel::data(const QModelIndex& index, int role) const
         }
         else
         {
-            switch (item->getItemType())
+            switch (m_table->type(id))
             {
             case XAXMLTreeItemType::ERROR:
                 return ic_light_error_mark;
@@ -110,9 +152,12 @@ QVariant XAXMLTreeModel::data(const QModelIndex& index, int role) const
             case XAXMLTreeItemType::ATTRIBUTE:
                 return ic_light_attribute;
 
+            case XAXMLTreeItemType::RANGE:
+                return ic_light_element_children;
+
             case XAXMLTreeItemType::ELEMENT:
             {
-                switch (item->childCount())
+                switch (row->child_items)
                 {
                 case 0:  return ic_light_element_empty;
                 case 1:  return ic_light_element_text;
@@ -130,6 +175,41 @@ QVariant XAXMLTreeModel::data(const QModelIndex& index, int role) const
     return QVariant();
 }
 
+const XAXMLTreeModel::CachedRow* XAXMLTreeModel::cachedRow(Id id) const
+{
+    auto row = m_row_cache.object(id);
+    if (row)
+        return row;
+
+    row = new CachedRow;
+    row->display = displayText(id);
+    row->child_items = std::min(childItemCount(id), 2);
+    m_row_cache.insert(id, row);
+    return row;
+}
+
+QString XAXMLTreeModel::displayText(Id id) const
+{
+    switch (m_table->type(id))
+    {
+    case XAXMLTreeItemType::ERROR:
+        return QString::fromUtf8(m_table->name(id));
+    case XAXMLTreeItemType::ATTRIBUTE:
+    {
+        auto attr = m_table->attribute(id);
+        return QString("%1 = \"%2\"").arg(QString::fromUtf8(attr.name()), QString::fromUtf8(attr.value()));
+    }
+    case XAXMLTreeItemType::ELEMENT:
+        return QString::fromUtf8(m_table->name(id));
+    case XAXMLTreeItemType::RANGE:
+    {
+        auto first = m_table->rangeFirst(id);
+        return QString("%1 [%2..%3]").arg(QString::fromUtf8(m_table->name(id))).arg(first).arg(first + m_table->rangeCount(id) - 1);
+    }
+    }
+    return QString();
+}
+
 Qt::ItemFlags XAXMLTreeModel::flags(const QModelIndex& index) const
 {
     if (!index.isValid())
@@ -144,34 +224,76 @@ QModelIndex XAXMLTreeModel::index(int row, int column,
     if (!hasIndex(row, column, parent))
         return QModelIndex();
 
-    XAXMLTreeItem* parent_item;
+    auto child_id = m_table->child(idFromIndex(parent), row);
+    if (child_id != XAXMLNodeTable::NoId)
+        return createIndex(row, column, static_cast<quintptr>(child_id));
+    return QModelIndex();
+}
+
+QModelIndex XAXMLTreeModel::indexFromId(Id id) const
+{
+    if (id == XAXMLNodeTable::RootId || id == XAXMLNodeTable::NoId)
+        return QModelIndex();
 
-    if (!parent.isValid()) 
-    {
-        parent_item = m_root_item;
-    }
-    else 
+    return createIndex(m_table->row(id), 0, static_cast<quintptr>(id));
+}
+
+XAXMLTreeModel::Id XAXMLTreeModel::idFromIndex(const QModelIndex& index) const
+{
+    if (!index.isValid())
+        return XAXMLNodeTable::RootId;
+    return static_cast<Id>(index.internalId());
+}
+
+QString XAXMLTreeModel::getPath(const QModelIndex& index, const QModelIndex& base) const
+{
+    QStringList steps;
+    for (auto current = index; current.isValid() && current != base; current = current.parent())
     {
-        parent_item = static_cast<XAXMLTreeItem*>(parent.internalPointer());
+        steps.prepend(QString("%1[%2]").arg(QString::fromUtf8(getName(current))).arg(current.row()));
     }
-
-    auto* child_item = parent_item->child(row);
-    if (child_item)
-        return createIndex(row, column, child_item);
-    return QModelIndex();
+    return steps.join('/');
 }
 
-QModelIndex XAXMLTreeModel::indexFromItem(XAXMLTreeItem* item) const
+QModelIndex XAXMLTreeModel::indexFromPath(const QString& path, const QModelIndex& base)
 {
-    if (!item || item == m_root_item)
-        return QModelIndex();
+    auto index = base;
+    if (path.isEmpty())
+        return index;
 
-    XAXMLTreeItem* parent_item = item->parent();
-    if (!parent_item)
-        return QModelIndex();
+    for (const auto& step : path.split('/'))
+    {
+        int bracket = step.lastIndexOf('[');
+        if (bracket < 0)
+            return QModelIndex();
+
+        auto name = step.left(bracket).toUtf8();
+        int row = step.mid(bracket + 1, step.size() - bracket - 2).toInt();
+
+        fetchChildren(index);
+        auto parent_id = idFromIndex(index);
+        auto child_id = m_table->child(parent_id, row);
+        if (child_id == XAXMLNodeTable::NoId || std::strcmp(m_table->name(child_id), name.constData()) != 0)
+        {
+            // siblings were inserted or removed in front of it
+            child_id = XAXMLNodeTable::NoId;
+            int count = m_table->childCount(parent_id);
+            for (int r = 0; r < count; ++r)
+            {
+                auto candidate = m_table->child(parent_id, r);
+                if (std::strcmp(m_table->name(candidate), name.constData()) == 0)
+                {
+                    child_id = candidate;
+                    break;
+                }
+            }
+        }
+        if (child_id == XAXMLNodeTable::NoId)
+            return QModelIndex();
 
-    int row = parent_item->children().indexOf(item);
-    return createIndex(row, 0, item);
+        index = indexFromId(child_id);
+    }
+    return index;
 }
 
 QModelIndex XAXMLTreeModel::parent(const QModelIndex& index) const
@@ -179,16 +301,21 @@ QModelIndex XAXMLTreeModel::parent(const QModelIndex& index) const
     if (!index.isValid())
         return QModelIndex();
 
-    auto child_item = static_cast<XAXMLTreeItem*>(index.internalPointer());
-    if (!child_item)
-        return QModelIndex();
+    return indexFromId(m_table->parent(idFromIndex(index)));
+}
 
-    auto parent_item = child_item->parentItem();
+QModelIndex XAXMLTreeModel::sibling(int row, int column, const QModelIndex& index) const
+{
+    if (!index.isValid() || column != 0)
+        return QModelIndex();
 
-    if (parent_item == m_root_item)
+    // siblings share a block of ids, no need to go through the parent
+    auto id = idFromIndex(index);
+    auto parent_id = m_table->parent(id);
+    if (row < 0 || row >= m_table->childCount(parent_id))
         return QModelIndex();
 
-    return createIndex(parent_item->row(), 0, parent_item);
+    return createIndex(row, 0, static_cast<quintptr>(id - index.row() + row));
 }
 
 int XAXMLTreeModel::rowCount(const QModelIndex& parent) const
@@ -196,26 +323,108 @@ int XAXMLTreeModel::rowCount(const QModelIndex& parent) const
     if (parent.column() > 0)
         return 0;
 
-    XAXMLTreeItem* parent_item;
+    return m_table->childCount(idFromIndex(parent));
+}
 
-    if (!parent.isValid())
-        parent_item = m_root_item;
-    else
-        parent_item = static_cast<XAXMLTreeItem*>(parent.internalPointer());
+int XAXMLTreeModel::columnCount(const QModelIndex& parent) const
+{
+    return 1;
+}
 
-    return parent_item->childCount();
+bool XAXMLTreeModel::hasChildren(const QModelIndex& parent) const
+{
+    if (parent.column() > 0)
+        return false;
+
+    // answered from the node, so the view draws the expander without creating the children
+    return childItemCount(idFromIndex(parent)) > 0;
 }
 
-int XAXMLTreeModel::columnCount(const QModelIndex& parent) const
+bool XAXMLTreeModel::canFetchMore(const QModelIndex& parent) const
+{
+    return !m_table->isFetched(idFromIndex(parent));
+}
+
+void XAXMLTreeModel::fetchMore(const QModelIndex& parent)
+{
+    fetchChildren(parent);
+}
+
+void XAXMLTreeModel::fetchChildren(const QModelIndex& index)
+{
+    auto id = idFromIndex(index);
+    if (m_table->isFetched(id))
+        return;
+
+    int count = XAXMLTreeBuilder::countRows(*m_table, id, m_group_size);
+    if (count == 0)
+    {
+        m_table->createChildren(id, 0);
+        return;
+    }
+
+    auto origin = getOrigin(id);
+    beginInsertRows(index, 0, count - 1);
+    XAXMLTreeBuilder::buildChildren(*m_table, id, count, getOffset(id), getEditCount(), m_group_size,
+        origin.node, *origin.offsets, *origin.spans, m_table->patch(id));
+    endInsertRows();
+}
+
+XAXMLTreeItemType XAXMLTreeModel::getItemType(const QModelIndex& index) const
 {
-    if (parent.isValid())
-        return static_cast<XAXMLTreeItem*>(parent.internalPointer())->columnCount();
-    return m_root_item->columnCount();
+    return m_table->type(idFromIndex(index));
 }
 
-XAXMLTreeItem* XAXMLTreeModel::rootItem() const
+pugi::xml_node XAXMLTreeModel::getNode(const QModelIndex& index) const
 {
-    return m_root_item;
+    return m_table->node(idFromIndex(index));
+}
+
+pugi::xml_attribute XAXMLTreeModel::getAttribute(const QModelIndex& index) const
+{
+    return m_table->attribute(idFromIndex(index));
+}
+
+const char* XAXMLTreeModel::getName(const QModelIndex& index) const
+{
+    return m_table->name(idFromIndex(index));
+}
+
+void XAXMLTreeModel::setNodeTable(std::unique_ptr<XAXMLNodeTable> table,
+    std::shared_ptr<const XAOffsetMap> offsets, std::shared_ptr<const XASpanIndex> spans)
+{
+    beginResetModel();
+    m_table = std::move(table);
+    m_offsets = std::move(offsets);
+    m_spans = std::move(spans);
+    m_edits.clear();
+    m_row_cache.clear();
+    m_sibling_steps.clear();
+    m_locate_steps.clear();
+    endResetModel();
+}
+
+const XAXMLNodeTable& XAXMLTreeModel::getNodeTable() const
+{
+    return *m_table;
+}
+
+void XAXMLTreeModel::setSiblingGroupSize(int size)
+{
+    if (size == m_group_size)
+        return;
+
+    beginResetModel();
+    m_group_size = size;
+    m_row_cache.clear();
+    m_sibling_steps.clear();
+    m_locate_steps.clear();
+    int count = m_table->childCount(XAXMLNodeTable::RootId);
+    for (int row = 0; row < count; ++row)
+    {
+        m_table->resetChildren(m_table->child(XAXMLNodeTable::RootId, row));
+    }
+    endResetModel();
 }
 
 void XAXMLTreeModel::updateAll()
@@ -228,6 +437,10 @@ void XAXMLTreeModel::updateAll()
 void XAXMLTreeModel::beginFillModel()
 {
     beginResetModel();
+    m_edits.clear();
+    m_row_cache.clear();
+    m_sibling_steps.clear();
+    m_locate_steps.clear();
 }
 
 void XAXMLTreeModel::endFillModel()
@@ -238,7 +451,496 @@ void XAXMLTreeModel::endFillModel()
 void XAXMLTreeModel::clear()
 {
     beginResetModel();
-    delete m_root_item;
-    m_root_item = new XAXMLTreeItem{ "ROOT" };
+    m_table = std::make_unique<XAXMLNodeTable>();
+    m_table->createChildren(XAXMLNodeTable::RootId, 0);
+    m_offsets = std::make_shared<XAOffsetMap>();
+    m_spans = std::make_shared<XASpanIndex>();
+    m_edits.clear();
+    m_row_cache.clear();
+    m_sibling_steps.clear();
+    m_locate_steps.clear();
     endResetModel();
-}
\ No newline at end of file
+}
+
+QModelIndex XAXMLTreeModel::indexAtOffset(int64_t position)
+{
+    QModelIndex index;
+    while (true)
+    {
+        fetchChildren(index);
+        auto child = childAtOffset(idFromIndex(index), position);
+        if (child == XAXMLNodeTable::NoId)
+            break;
+
+        index = indexFromId(child);
+        if (m_table->type(child) != XAXMLTreeItemType::ELEMENT && m_table->type(child) != XAXMLTreeItemType::RANGE)
+            break;
+    }
+    return index;
+}
+
+XAXMLTreeModel::Location XAXMLTreeModel::locate(int64_t position) const
+{
+    Location location = { pugi::xml_node(), pugi::xml_attribute(), -1, -1, QModelIndex() };
+
+    // down the items that exist
+    Id id = XAXMLNodeTable::RootId;
+    while (m_table->isFetched(id))
+    {
+        auto child = childAtOffset(id, position);
+        if (child == XAXMLNodeTable::NoId)
+            break;
+        id = child;
+        if (m_table->type(id) != XAXMLTreeItemType::ELEMENT && m_table->type(id) != XAXMLTreeItemType::RANGE)
+            break;
+    }
+    location.index = indexFromId(id);
+
+    // the element of the item, an attribute or a range is inside of one
+    auto element_id = id;
+    while (element_id != XAXMLNodeTable::RootId && m_table->type(element_id) != XAXMLTreeItemType::ELEMENT)
+    {
+        element_id = m_table->parent(element_id);
+    }
+    if (element_id != XAXMLNodeTable::RootId)
+    {
+        location.element = m_table->node(element_id);
+        location.attribute = m_table->attribute(id);
+        location.offset = getOffset(element_id);
+        location.end = getEndOffset(element_id);
+    }
+
+    auto type = m_table->type(id);
+    if (m_table->isFetched(id) || (type != XAXMLTreeItemType::ELEMENT && type != XAXMLTreeItemType::RANGE))
+        return location;
+
+    // below an item that was not expanded, its nodes keep their distance to the item, see XAXMLTreeBuilder::buildChildren
+    auto origin = getOrigin(id);
+    auto node_offset = origin.offsets->toPosition(origin.node.offset_debug());
+    if (getOffset(id) < 0 || node_offset < 0)
+        return location;
+    auto shift = getOffset(id) - node_offset;
+    auto offset = origin.offsets->toOffset(position - shift);
+
+    // the walk goes through the nodes of the origin, a range has no attributes of its own
+    auto element = (type == XAXMLTreeItemType::ELEMENT) ? origin.node : pugi::xml_node();
+    auto first = (type == XAXMLTreeItemType::RANGE) ? origin.node : origin.node.first_child();
+    for (size_t depth = 0; ; ++depth)
+    {
+        auto child = elementAtOrBefore(first, offset, depth);
+        if (!child)
+            break;
+
+        // an element that was not closed is taken to reach up to the next one
+        auto end = origin.spans->elementEnd(child.offset_debug());
+        if (end >= 0 && offset >= end)
+            break;
+
+        first = child.first_child();
+        element = child;
+        location.offset = shift + origin.offsets->toPosition(child.offset_debug());
+        location.end = end < 0 ? -1 : shift + origin.offsets->toPosition(end);
+    }
+    if (!element)
+        return location;
+
+    // a copied node stands in the DOM at the place of the origin node
+    location.element = (origin.node == m_table->node(id)) ? element : counterpart(element, origin.node, m_table->node(id));
+
+    // the attributes of the element are in its spans in document order
+    auto spans = origin.spans->attributeSpans(element.offset_debug());
+    size_t index = 0;
+    for (auto attr = location.element.first_attribute(); attr && index < spans.size(); attr = attr.next_attribute(), ++index)
+    {
+        if (spans[index].offset <= offset && offset < spans[index].end)
+        {
+            location.attribute = attr;
+            break;
+        }
+    }
+    return location;
+}
+
+QModelIndex XAXMLTreeModel::indexAtLocation(const Location& location)
+{
+    QModelIndex index;
+    Id id = XAXMLNodeTable::RootId;
+    while (location.element && !(m_table->type(id) == XAXMLTreeItemType::ELEMENT && m_table->node(id) == location.element))
+    {
+        fetchChildren(index);
+        auto child = childAtOffset(id, location.offset);
+        if (child == XAXMLNodeTable::NoId)
+            break;
+
+        auto type = m_table->type(child);
+        if (type != XAXMLTreeItemType::ELEMENT && type != XAXMLTreeItemType::RANGE)
+            break;
+
+        id = child;
+        index = indexFromId(child);
+    }
+    return index;
+}
+
+QString XAXMLTreeModel::getLocationPath(const QModelIndex& index) const
+{
+    auto id = idFromIndex(index);
+    if (id == XAXMLNodeTable::RootId || m_table->type(id) == XAXMLTreeItemType::ERROR)
+        return QString();
+
+    return getLocationPath(m_table->node(id), m_table->attribute(id));
+}
+
+QString XAXMLTreeModel::getLocationPath(const pugi::xml_node& element, const pugi::xml_attribute& attribute) const
+{
+    std::vector<pugi::xml_node> nodes;
+    for (auto node = element; node.type() == pugi::node_element; node = node.parent())
+    {
+        nodes.push_back(node);
+    }
+
+    QString path;
+    for (size_t depth = 0; depth < nodes.size(); ++depth)
+    {
+        const auto& node = nodes[nodes.size() - 1 - depth];
+        path += QLatin1Char('/') + QString::fromUtf8(node.name());
+
+        const auto& step = siblingStep(node, depth);
+        if (!step.alone)
+            path += QStringLiteral("[%1]").arg(step.position);
+    }
+
+    if (attribute)
+        path += QStringLiteral("/@") + QString::fromUtf8(attribute.name());
+
+    return path;
+}
+
+const XAXMLTreeModel::SiblingStep& XAXMLTreeModel::siblingStep(const pugi::xml_node& node, size_t depth) const
+{
+    if (m_sibling_steps.size() <= depth)
+        m_sibling_steps.resize(depth + 1, { pugi::xml_node(), 0, true });
+
+    auto& step = m_sibling_steps[depth];
+    if (step.node == node)
+        return step;
+
+    auto name = node.name();
+    int position = 0;
+    bool alone = true;
+
+    // walk both ways from the last step, a long sibling list is only counted through once
+    if (step.node && step.node.parent() == node.parent() && strcmp(step.node.name(), name) == 0)
+    {
+        alone = false;
+        auto next = step.node;
+        auto previous = step.node;
+        for (int distance = 1; position == 0 && (next || previous); ++distance)
+        {
+            if (next)
+            {
+                next = next.next_sibling(name);
+                if (next == node)
+                    position = step.position + distance;
+            }
+            if (previous)
+            {
+                previous = previous.previous_sibling(name);
+                if (previous == node)
+                    position = step.position - distance;
+            }
+        }
+    }
+
+    if (position == 0)
+    {
+        position = 1;
+        for (auto previous = node.previous_sibling(name); previous; previous = previous.previous_sibling(name))
+        {
+            ++position;
+        }
+        alone = position == 1 && !node.next_sibling(name);
+    }
+
+    step = { node, position, alone };
+
+    // deeper steps belong to another parent now
+    m_sibling_steps.resize(depth + 1);
+    return m_sibling_steps[depth];
+}
+
+XAXMLTreeModel::Id XAXMLTreeModel::childAtOffset(Id id, int64_t position) const
+{
+    // last child starting at or before the position
+    int first = 0;
+    int count = m_table->childCount(id);
+    while (count > 0)
+    {
+        int step = count / 2;
+        if (getStartOffset(m_table->child(id, first + step)) <= position)
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    if (first == 0)
+        return XAXMLNodeTable::NoId;
+
+    // an element that was not closed is taken to reach up to the next one
+    auto child = m_table->child(id, first - 1);
+    auto end = getEndOffset(child);
+    if (end >= 0 && position >= end)
+        return XAXMLNodeTable::NoId;
+    return child;
+}
+
+pugi::xml_node XAXMLTreeModel::elementAtOrBefore(const pugi::xml_node& first, int64_t offset, size_t depth) const
+{
+    // a copied node has no offset, it is the patched element behind the range this walk started in
+    auto starts = [offset](const pugi::xml_node& node) { return node.offset_debug() >= 0 && node.offset_debug() - 1 <= offset; };
+    auto isElement = [](const pugi::xml_node& node) { return node.type() == pugi::node_element; };
+
+    if (m_locate_steps.size() <= depth)
+        m_locate_steps.resize(depth + 1);
+
+    // the cursor moves a little at a time, so the element is close to the one found last
+    auto node = first;
+    const auto& step = m_locate_steps[depth];
+    if (step && step.parent() == first.parent() && step.offset_debug() >= first.offset_debug())
+        node = step;
+
+    while (node && !isElement(node))
+    {
+        node = node.next_sibling();
+    }
+
+    if (node && !starts(node))
+    {
+        // walk back, but not in front of first
+        do
+        {
+            if (node == first)
+                return pugi::xml_node();
+            node = node.previous_sibling();
+        } while (node && !(isElement(node) && starts(node)));
+    }
+    else if (node)
+    {
+        for (auto next = node.next_sibling(); next && (!isElement(next) || starts(next)); next = next.next_sibling())
+        {
+            if (isElement(next))
+                node = next;
+        }
+    }
+
+    // deeper steps belong to another parent now
+    if (node && node != m_locate_steps[depth])
+    {
+        m_locate_steps[depth] = node;
+        m_locate_steps.resize(depth + 1);
+    }
+    return node;
+}
+
+int64_t XAXMLTreeModel::getOffset(const QModelIndex& index) const
+{
+    return getOffset(idFromIndex(index));
+}
+
+int64_t XAXMLTreeModel::getOffset(Id id) const
+{
+    auto offset = m_table->offset(id);
+    if (offset < 0)
+        return offset;
+
+    // replay the edits made after the item was built
+    for (size_t i = m_table->epoch(id); i < m_edits.size(); ++i)
+    {
+        if (offset >= m_edits[i].position)
+        {
+            offset += m_edits[i].delta;
+        }
+    }
+    return offset;
+}
+
+int64_t XAXMLTreeModel::getEndOffset(const QModelIndex& index) const
+{
+    return getEndOffset(idFromIndex(index));
+}
+
+int64_t XAXMLTreeModel::getEndOffset(Id id) const
+{
+    auto end = m_table->hasEnd(id) ? m_table->end(id) : getSpanEnd(id);
+    if (end < 0)
+        return end;
+
+    // text inserted right behind the item is not part of it
+    for (size_t i = m_table->epoch(id); i < m_edits.size(); ++i)
+    {
+        if (end > m_edits[i].position)
+        {
+            end += m_edits[i].delta;
+        }
+    }
+    return end;
+}
+
+int64_t XAXMLTreeModel::getSpanEnd(Id id) const
+{
+    auto offset = m_table->offset(id);
+    if (offset < 0)
+        return -1;
+
+    // the text of the item kept its length since the offset was set
+    XASpanIndex::Span span = { -1, -1 };
+    Origin origin = { pugi::xml_node(), m_offsets.get(), m_spans.get() };
+    switch (m_table->type(id))
+    {
+    case XAXMLTreeItemType::ELEMENT:
+    {
+        origin = getOrigin(id);
+        auto node_offset = origin.node.offset_debug();
+        span = { node_offset, origin.spans->elementEnd(node_offset) };
+    } break;
+
+    case XAXMLTreeItemType::ATTRIBUTE:
+    {
+        // attributes come first among the children of their element
+        origin = getOrigin(m_table->parent(id));
+        auto spans = origin.spans->attributeSpans(origin.node.offset_debug());
+        auto row = static_cast<size_t>(m_table->row(id));
+        if (row < spans.size())
+            span = spans[row];
+    } break;
+
+    default:
+        break;
+    }
+
+    if (span.offset < 0 || span.end < 0)
+        return -1;
+    return offset + origin.offsets->toPosition(span.end) - origin.offsets->toPosition(span.offset);
+}
+
+XAXMLTreeModel::Origin XAXMLTreeModel::getOrigin(Id id) const
+{
+    const auto& patch = m_table->patch(id);
+    if (patch)
+        return { m_table->source(id), &patch->offsets, &patch->spans };
+    return { m_table->node(id), m_offsets.get(), m_spans.get() };
+}
+
+int64_t XAXMLTreeModel::getStartOffset(Id id) const
+{
+    // items without an offset sort behind all others
+    auto offset = getOffset(id);
+    if (offset < 0)
+        return INT64_MAX;
+
+    // element offsets point at the name, their text starts with the bracket
+    return m_table->type(id) == XAXMLTreeItemType::ATTRIBUTE ? offset : offset - 1;
+}
+
+void XAXMLTreeModel::recordEdit(int64_t position, int64_t delta)
+{
+    if (delta == 0)
+        return;
+
+    m_edits.push_back({ position, delta });
+
+    if (m_edits.size() > MaxPendingEdits)
+    {
+        applyEdits();
+        m_edits.clear();
+    }
+}
+
+int XAXMLTreeModel::getEditCount() const
+{
+    return static_cast<int>(m_edits.size());
+}
+
+void XAXMLTreeModel::beginReplaceNode(const QModelIndex& index)
+{
+    emit nodeAboutToBeReplaced(index);
+
+    // the steps may point into the subtree that is about to go, the ids below it are handed out again
+    m_sibling_steps.clear();
+    m_locate_steps.clear();
+    m_row_cache.clear();
+
+    auto id = idFromIndex(index);
+    int count = m_table->childCount(id);
+    if (count > 0)
+    {
+        beginRemoveRows(index, 0, count - 1);
+        m_table->resetChildren(id);
+        endRemoveRows();
+    }
+    else
+    {
+        m_table->resetChildren(id);
+    }
+}
+
+void XAXMLTreeModel::endReplaceNode(const QModelIndex& index, const pugi::xml_node& node, std::shared_ptr<const XAXMLPatch> patch)
+{
+    auto id = idFromIndex(index);
+
+    // ranges starting with the replaced node have to follow it
+    auto old_node = m_table->node(id);
+    for (auto parent_id = m_table->parent(id);
+        m_table->type(parent_id) == XAXMLTreeItemType::RANGE && m_table->node(parent_id) == old_node;
+        parent_id = m_table->parent(parent_id))
+    {
+        m_table->setNode(parent_id, node);
+        m_row_cache.remove(parent_id);
+
+        auto range_index = indexFromId(parent_id);
+        emit dataChanged(range_index, range_index);
+    }
+
+    // the new subtree is built when the item is expanded, until then nothing below it exists
+    auto source = patch->document.document_element();
+    m_table->setElement(id, node);
+    m_table->setOffset(id, patch->base + patch->offsets.toPosition(source.offset_debug()), getEditCount());
+    m_table->clearEnd(id);
+    m_table->setSource(id, source, std::move(patch));
+
+    m_row_cache.remove(id);
+    emit dataChanged(index, index);
+    emit nodeReplaced(index);
+}
+
+int XAXMLTreeModel::childItemCount(Id id) const
+{
+    // decides the element icon and the expander, more than two items are not told apart
+    if (m_table->isFetched(id))
+        return m_table->childCount(id);
+    if (m_table->type(id) == XAXMLTreeItemType::RANGE)
+        return m_table->rangeCount(id);
+    return XAXMLTreeBuilder::countChildren(m_table->node(id), 2);
+}
+
+void XAXMLTreeModel::applyEdits()
+{
+    for (Id id = 0; id < static_cast<Id>(m_table->size()); ++id)
+    {
+        if (!m_table->isUsed(id))
+            continue;
+
+        auto end = getEndOffset(id);
+        m_table->setOffset(id, getOffset(id), 0);
+
+        // an edit inside the item changed its length, the span index does not know about that
+        if (end != getSpanEnd(id))
+            m_table->setEnd(id, end);
+        else
+            m_table->clearEnd(id);
+    }
+}
@@ -17,18 +17,29 @@
 
 #pragma once
 
+#include "xa_xml_node_table.h"
+#include "xa_offset_map.h"
+#include "xa_span_index.h"
 #include <QAbstractItemModel>
+#include <QCache>
+#include <memory>
+#include <vector>
 
 
-class XAXMLTreeItem;
 class XATheme;
 
 
+/**
+ * Tree of elements and attributes on top of a XAXMLNodeTable
+ * The internal id of an index is the item id in the table.
+ */
 class XAXMLTreeModel : public QAbstractItemModel
 {
     Q_OBJECT
 
 public:
+    using Id = XAXMLNodeTable::Id;
+
     XAXMLTreeModel(XATheme* theme, QObject* parent = nullptr);
     ~XAXMLTreeModel();
 
@@ -38,14 +49,99 @@ public:
     QModelIndex index(int row, int column,
         const QModelIndex& parent = QModelIndex()) const override;
 
-    QModelIndex indexFromItem(XAXMLTreeItem* item) const;
+    QModelIndex indexFromId(Id id) const;
+    Id idFromIndex(const QModelIndex& index) const;
+
+    /**
+     * Identity of an index that survives rebuilding the tree: "catalog[0]/book[17]/title[2]"
+     * Each step is the item name with its row below the parent, relative to base.
+     */
+    QString getPath(const QModelIndex& index, const QModelIndex& base = QModelIndex()) const;
+
+    /**
+     * Resolves a path from getPath in the current tree
+     * If the row moved the first sibling with the same name is taken.
+     */
+    QModelIndex indexFromPath(const QString& path, const QModelIndex& base = QModelIndex());
 
     QModelIndex parent(const QModelIndex& index) const override;
+    QModelIndex sibling(int row, int column, const QModelIndex& index) const override;
 
     int rowCount(const QModelIndex& parent = QModelIndex()) const override;
     int columnCount(const QModelIndex& parent = QModelIndex()) const override;
 
-    XAXMLTreeItem* rootItem() const;
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+    /**
+     * Creates the child items of the index unless that was done before
+     */
+    void fetchChildren(const QModelIndex& index);
+
+    /**
+     * Innermost item whose text contains the editor position, an attribute if the position is in one
+     * The children of an item are disjoint spans sorted by offset, so every level is one binary search.
+     * The items on the way down are fetched.
+     */
+    QModelIndex indexAtOffset(int64_t position);
+
+    /**
+     * What indexAtOffset finds, without creating any items
+     */
+    struct Location
+    {
+        pugi::xml_node      element;    // innermost element around the position, empty outside all
+        pugi::xml_attribute attribute;  // the attribute of element the position is in, if any
+        int64_t             offset;     // editor position of the element name, -1 without an element
+        int64_t             end;        // editor position behind the element, -1 if it is not known
+        QModelIndex         index;      // innermost item created so far around the position
+    };
+
+    /**
+     * Looks the position up in the items created so far, and below them in the DOM and the span index
+     * Cheap enough for every cursor move, the tree does not grow from it.
+     */
+    Location locate(int64_t position) const;
+
+    /**
+     * Item of the element locate found, the items on the way down are fetched
+     * The children of the element itself are not. Ends at the innermost item on the way
+     * if the element is not reached.
+     */
+    QModelIndex indexAtLocation(const Location& location);
+
+    /**
+     * Location of the item as element steps, like /catalog/book[17]/title, an attribute adds /@name
+     * Positions among same named siblings are counted from the step found last at the same depth,
+     * which is close by while the cursor moves through the text.
+     */
+    QString getLocationPath(const QModelIndex& index) const;
+
+    /**
+     * The same for an element, or an attribute of it, as found by locate
+     */
+    QString getLocationPath(const pugi::xml_node& element, const pugi::xml_attribute& attribute) const;
+
+    XAXMLTreeItemType getItemType(const QModelIndex& index) const;
+    pugi::xml_node getNode(const QModelIndex& index) const;
+    pugi::xml_attribute getAttribute(const QModelIndex& index) const;
+    const char* getName(const QModelIndex& index) const;
+
+    /**
+     * Replaces all items with a table built elsewhere
+     * offsets translates the byte offsets of the DOM and spans locates its elements and attributes,
+     * later fetches need them as well.
+     */
+    void setNodeTable(std::unique_ptr<XAXMLNodeTable> table,
+        std::shared_ptr<const XAOffsetMap> offsets, std::shared_ptr<const XASpanIndex> spans);
+    const XAXMLNodeTable& getNodeTable() const;
+
+    /**
+     * Element lists longer than size are shown in range items of at most size rows, 0 shows them flat
+     * Changing it collapses the tree below the top level.
+     */
+    void setSiblingGroupSize(int size);
 
     void updateAll();
 
@@ -53,7 +149,115 @@ public:
     void endFillModel();
 
     void clear();
+
+    /**
+     * Editor position of the item, corrected by the edits recorded since the item was built
+     */
+    int64_t getOffset(const QModelIndex& index) const;
+
+    /**
+     * Editor position behind the text of the item, -1 if it is not known
+     */
+    int64_t getEndOffset(const QModelIndex& index) const;
+
+    /**
+     * Records an edit of the editor text, items at or behind position move by delta
+     */
+    void recordEdit(int64_t position, int64_t delta);
+
+    /**
+     * Number of recorded edits, items built now carry it as their epoch
+     */
+    int getEditCount() const;
+
+    /**
+     * Removes the children of the item before its node is replaced in the DOM
+     */
+    void beginReplaceNode(const QModelIndex& index);
+
+    /**
+     * Points the item at the node that replaced its old one, copied from the element of patch
+     * The item is left unfetched, its children are created from the patch when it is expanded.
+     */
+    void endReplaceNode(const QModelIndex& index, const pugi::xml_node& node, std::shared_ptr<const XAXMLPatch> patch);
+
+signals:
+    /**
+     * Emitted around beginReplaceNode and endReplaceNode, the index stays valid
+     */
+    void nodeAboutToBeReplaced(const QModelIndex& index);
+    void nodeReplaced(const QModelIndex& index);
+
 private:
+    struct SiblingStep
+    {
+        pugi::xml_node  node;
+        int             position;
+        bool            alone;
+    };
+
+    struct CachedRow
+    {
+        QString display;
+        int     child_items;
+    };
+
+    /**
+     * Where offsets and spans find the node of an item, in the document or in the patch it was copied from
+     */
+    struct Origin
+    {
+        pugi::xml_node      node;
+        const XAOffsetMap*  offsets;
+        const XASpanIndex*  spans;
+    };
+
+    Origin getOrigin(Id id) const;
+
+    /**
+     * Display data of the row, built on first use and dropped when the item changes
+     */
+    const CachedRow* cachedRow(Id id) const;
+    QString displayText(Id id) const;
+
+    const SiblingStep& siblingStep(const pugi::xml_node& node, size_t depth) const;
+
+    /**
+     * Child item whose text contains the position, NoId if none does or the children were not created
+     */
+    Id childAtOffset(Id id, int64_t position) const;
+
+    /**
+     * Last element among the siblings of first, from first on, that starts at or before the byte offset
+     * The search starts at the element found last at the same depth.
+     */
+    pugi::xml_node elementAtOrBefore(const pugi::xml_node& first, int64_t offset, size_t depth) const;
+
+    int64_t getOffset(Id id) const;
+    int64_t getEndOffset(Id id) const;
+
+    /**
+     * End of the item at the epoch of its offset as the span index tells it, -1 if it does not
+     */
+    int64_t getSpanEnd(Id id) const;
+    int64_t getStartOffset(Id id) const;
+    int childItemCount(Id id) const;
+    void applyEdits();
+
+private:
+    struct Edit
+    {
+        int64_t position;
+        int64_t delta;
+    };
+
     XATheme* m_theme;
-    XAXMLTreeItem* m_root_item;
+    std::unique_ptr<XAXMLNodeTable> m_table;
+    std::shared_ptr<const XAOffsetMap> m_offsets;
+    std::shared_ptr<const XASpanIndex> m_spans;
+    std::vector<Edit> m_edits;
+    int m_group_size;
+    mutable QCache<Id, CachedRow> m_row_cache;
+    mutable std::vector<SiblingStep> m_sibling_steps;
+    mutable std::vector<pugi::xml_node> m_locate_steps;
 };
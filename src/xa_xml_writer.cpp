@@ -16,31 +16,40 @@
  */
 
 #include "xa_xml_writer.h"
+#include "xa_byte_scan.h"
 #include <string>
 #include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <locale>
 
 namespace
 {
-    std::string trim(const std::string& str)
+    // the characters std::isspace knows in the C locale
+    const XAByteScan& spaces()
     {
-        auto start = std::find_if_not(str.begin(), str.end(), [](unsigned char ch) {
-            return std::isspace(ch);
-            });
+        static const XAByteScan scan(" \t\n\v\f\r");
+        return scan;
+    }
 
-        auto end = std::find_if_not(str.rbegin(), str.rend(), [](unsigned char ch) {
-            return std::isspace(ch);
-            }).base();
+    const XAByteScan& newlines()
+    {
+        static const XAByteScan scan("\n");
+        return scan;
+    }
 
-        if (start < end)
-        {
-            return std::string(start, end);
-        }
-        else
+    std::string trim(const char* str, size_t size)
+    {
+        auto start = spaces().skip(str, size, 0);
+
+        // trailing space is short, it is looked at from the back
+        auto end = size;
+        while (end > start && std::isspace(static_cast<unsigned char>(str[end - 1])))
         {
-            return std::string();
+            --end;
         }
+
+        return std::string(str + start, end - start);
     }
 
     /**
@@ -114,23 +123,26 @@ namespace
 
         bool write_pcdata(const pugi::xml_node& node)
         {
-            std::string value = trim(node.value());
+            auto text = node.value();
+            std::string value = trim(text, strlen(text));
             // is it a single line?
-            if (value.find('\n') == std::string::npos)
+            auto line_end = newlines().find(value.data(), value.size(), 0);
+            if (line_end == value.size())
             {
                 result << value;
             }
             else
             {
                 // multiline
-                std::stringstream ss(value);
-                std::string line;
+                size_t line_start = 0;
                 result << '\n';
                 ++current_indent;
-                while (std::getline(ss, line))
+                while (line_start < value.size())
                 {
                     write_indent();
-                    result << trim(line) << '\n';
+                    result << trim(value.data() + line_start, line_end - line_start) << '\n';
+                    line_start = line_end + 1;
+                    line_end = newlines().find(value.data(), value.size(), line_start);
                 }
                 --current_indent;
                 return true;